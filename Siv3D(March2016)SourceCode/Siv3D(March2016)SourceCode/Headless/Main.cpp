@@ -0,0 +1,84 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include "../Lighting/DrawList.hpp"
+#include "../Lighting/FramePipeline.hpp"
+
+//ウィンドウなしでフィールドを動かし、1フレームの時間と明るさの合計を出力する
+//パイプラインを1にすると、各フレームを描画命令に記録して出力するところまでFramePipelineで実行する
+//使い方: CellularAutomatonLighting2DHeadless [フレーム数] [セルの大きさ(px)] [ライトの数] [パイプライン(0/1)]
+//Runs the field without a window and prints the time per frame and the sum of brightness.
+//With pipeline set to 1, FramePipeline runs each frame up to recording it into draw commands and exporting them.
+//Usage: CellularAutomatonLighting2DHeadless [frames] [cell size (px)] [lights] [pipeline (0/1)]
+int main(int argc, char* argv[])
+{
+	const int frames = 1 < argc ? std::atoi(argv[1]) : 600;
+	const int gridUnitPixel = 2 < argc ? std::atoi(argv[2]) : 8;
+	const int numLights = 3 < argc ? std::atoi(argv[3]) : 0;
+	const bool pipelined = 4 < argc && std::atoi(argv[4]) != 0;
+
+	lighting::Field field(lighting::Size(1280, 736), gridUnitPixel);
+	field.reserveLights(field.numLights() + numLights);
+	for (int i = 0; i < numLights; ++i)
+	{
+		field.addLight(lighting::RandomVec2(lighting::RectF(0, 0, lighting::Size(1280, 736)).stretched(-gridUnitPixel)), lighting::HSV(36.0*i, 0.7, 1.0));
+	}
+
+	const auto begin = std::chrono::steady_clock::now();
+	if (pipelined)
+	{
+		//出力では記録した描画命令の数を数えるだけにする
+		//Export only counts the recorded draw commands.
+		std::array<lighting::DrawList, lighting::FramePipeline::NumSlots> drawLists;
+		size_t numCommands = 0;
+
+		lighting::TaskGraph graph;
+		lighting::FramePipeline pipeline(field, graph, [&](const lighting::Field& f, size_t slot)
+		{
+			drawLists[slot].clear();
+			f.draw(drawLists[slot]);
+		}, [&](size_t slot, lighting::uint64)
+		{
+			numCommands += drawLists[slot].size();
+		});
+
+		const lighting::InputSnapshot input;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			pipeline.submit(input);
+		}
+		pipeline.finish();
+		std::printf("%zu draw commands on %zu workers\n", numCommands, graph.executor().concurrency());
+	}
+	else
+	{
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			field.update();
+		}
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	//LODを使わないので細かい格子だけを足せばよい。逐次で畳み込み、合計がコア数で変わらないようにする
+	//LOD is not used, so summing the fine grid is enough. It is folded sequentially so the sum does not depend on the core count.
+	const lighting::Size size = field.gridSize();
+	const double sum = lighting::TransformReduce(lighting::execution::seq, field.brightnessGrid(), 0.0, std::plus<double>(), [](const lighting::ColorF& color)
+	{
+		return color.r + color.g + color.b;
+	});
+
+	const double milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+	std::printf("%d frames, %dx%d cells, %zu lights: %.3f ms/frame, brightness sum %.6f\n", frames, size.x, size.y, field.numLights(), 0 < frames ? milliseconds / frames : 0.0, sum);
+	return 0;
+}
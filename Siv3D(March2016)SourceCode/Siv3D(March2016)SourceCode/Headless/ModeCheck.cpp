@@ -0,0 +1,514 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include "../Lighting/Field.hpp"
+
+//決まったマップで各モードの明るさを既定の伝播と比べ、差が許容範囲を超えたら失敗する
+//比べる状態は5つ: 最初の配置、壁を足してライトを動かした後、入口の斜めを壁で閉じた後、部屋の壁に穴を開けた後、ライトを1つ取り除き別のライトを遠くの部屋へ動かした後
+//Compares brightness of each mode with the default propagation on a fixed map, and fails when the difference exceeds the tolerance.
+//Five states are compared: the initial layout, after adding walls and moving a light, after closing diagonals of a doorway with a wall, after opening a hole in a room wall, and after removing a light and moving another to a distant room.
+namespace
+{
+	using namespace lighting;
+
+	const Size FieldSize(1280, 736);
+	const int GridUnitPixel = 8;
+
+	//完全に一致するはずのモードの許容誤差
+	//Tolerance of modes that should match exactly.
+	const double Exact = 1e-12;
+
+	//LODの最初の帯で、2倍の粗さの格子を補間した明るさに許す誤差
+	//壁を含む粗いセルは壁になるので、壁や柱の隣のセルは1つ遠い粗いセルから補間され、明るいライトの近くでは0.25ほど暗くなる
+	//Tolerance of brightness interpolated from the grid twice as coarse in the first LOD band.
+	//Coarse cells containing a wall become walls, so cells beside walls and pillars interpolate from coarse cells one step farther, and turn about 0.25 darker near bright lights.
+	const double LodTolerance = 0.3;
+
+	struct TestLight
+	{
+		Vec2 pos;
+		ColorF color;
+		double range;
+	};
+
+	//部屋を縦横の壁で区切り、幅3セルの入口を開ける。右下の部屋だけ柱と斜めの壁を置き、左上の部屋は壁のないまま残す
+	//Split rooms by vertical and horizontal walls with doorways 3 cells wide. Only the bottom right rooms get pillars and a diagonal wall, and the top left room is left without walls.
+	void buildMap(Field& field)
+	{
+		const Size size = field.gridSize();
+		auto edit = field.editWalls();
+
+		for (int x = 40; x < size.x; x += 40)
+		{
+			edit.rect(Rect(x, 1, 1, size.y - 2), Field::FieldWall());
+			for (int y = 10; y < size.y; y += 30)
+			{
+				edit.rect(Rect(x, y, 1, 3), Field::FieldSpace());
+			}
+		}
+
+		edit.rect(Rect(1, 46, size.x - 2, 1), Field::FieldWall());
+		for (int x = 15; x < size.x; x += 40)
+		{
+			edit.rect(Rect(x, 46, 3, 1), Field::FieldSpace());
+		}
+
+		for (int i = 0; i < 24; ++i)
+		{
+			edit.set(Point(82 + (i * 37) % 74, 50 + (i * 53) % 38), Field::FieldWall());
+		}
+		edit.line(Point(100, 60), Point(130, 85), Field::FieldWall());
+	}
+
+	//4番目のライトは壁の中に置く
+	//The fourth light is placed inside a wall.
+	std::vector<TestLight> testLights(bool equalRanges)
+	{
+		const std::vector<TestLight> lights =
+		{
+			{ Vec2(20, 20) * GridUnitPixel, HSV(0.0, 0.7, 1.0), 12.0 },
+			{ Vec2(35, 30) * GridUnitPixel, HSV(60.0, 0.7, 1.0), 30.0 },
+			{ Vec2(70, 20) * GridUnitPixel, HSV(120.0, 0.7, 1.0), 45.0 },
+			{ Vec2(40.5, 25.5) * GridUnitPixel, ColorF(1.0, 1.0, 1.0), 25.0 },
+			{ Vec2(110, 70) * GridUnitPixel, HSV(180.0, 0.7, 1.0), 20.0 },
+			{ Vec2(95, 55) * GridUnitPixel, HSV(240.0, 0.7, 1.0), 30.0 },
+			{ Vec2(140, 30) * GridUnitPixel, HSV(300.0, 0.7, 1.0), 12.0 },
+			{ Vec2(20, 75) * GridUnitPixel, HSV(30.0, 0.7, 1.0), 45.0 },
+		};
+
+		if (!equalRanges)
+		{
+			return lights;
+		}
+
+		std::vector<TestLight> equal = lights;
+		for (auto& light : equal)
+		{
+			light.range = 30.0;
+		}
+		return equal;
+	}
+
+	//configureでモードを設定したフィールドを状態ごとにframes回更新し、各状態の明るさを返す
+	//onlyLightが0以上なら、そのライトだけを置く。composedならLODの段を補間したcomposeLightmap(1.0)を返す
+	//Update a field whose mode is set by configure frames times per state, and return the brightness of each state.
+	//When onlyLight is 0 or more, only that light is placed. When composed, composeLightmap(1.0) with LOD levels interpolated is returned.
+	std::vector<Grid2D<ColorF>> computeStates(Executor& executor, const std::function<void(Field&)>& configure, bool equalRanges, int frames = 1, int onlyLight = -1, bool composed = false)
+	{
+		Field field(FieldSize, GridUnitPixel);
+		field.setExecutor(executor);
+		field.clearLights();
+		buildMap(field);
+		configure(field);
+
+		const auto lights = testLights(equalRanges);
+		std::vector<LightHandle> handles(lights.size());
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			if (onlyLight < 0 || static_cast<size_t>(onlyLight) == i)
+			{
+				handles[i] = field.addLight(lights[i].pos, lights[i].color, Vec2(0, 0), 1.0, lights[i].range);
+			}
+		}
+
+		std::vector<Grid2D<ColorF>> states;
+		const auto record = [&]
+		{
+			for (int i = 0; i < frames; ++i)
+			{
+				field.updateLighting();
+			}
+			states.push_back(composed ? field.composeLightmap(1.0) : field.brightnessGrid());
+		};
+
+		record();
+
+		field.editWalls().rect(Rect(26, 26, 6, 2), Field::FieldWall()).set(Point(80, 10), Field::FieldWall()).set(Point(80, 12), Field::FieldWall());
+		if (field.isAlive(handles[1]))
+		{
+			field.setLightPos(handles[1], Vec2(30, 36) * GridUnitPixel);
+		}
+		record();
+
+		//幅1セルにした入口の先に1セルだけ壁を足すと、入口から斜めに抜ける光が遮られる
+		//A single wall cell just past the doorway narrowed to one cell blocks light passing it diagonally.
+		field.editWalls().set(Point(81, 11), Field::FieldWall());
+		record();
+
+		field.editWalls().rect(Rect(80, 30, 1, 8), Field::FieldSpace());
+		record();
+
+		//取り除いたライトと動かしたライトの元の場所の光は、ウォームスタートでも消えていなければならない
+		//Light of the removed light and at the old place of the moved one must be cleared, even with warm start.
+		if (field.isAlive(handles[4]))
+		{
+			field.removeLight(handles[4]);
+		}
+		if (field.isAlive(handles[2]))
+		{
+			field.setLightPos(handles[2], Vec2(140, 75) * GridUnitPixel);
+		}
+		record();
+
+		return states;
+	}
+
+	//壁のない場所で、届く範囲の狭い明るいライトを届く範囲の広い暗いライトに重ねる
+	//既定の伝播では明るいライトの光が暗いライトの範囲を伝わってさらに先へ届く
+	//On an open area, a bright light of short reach overlaps a dim light of long reach.
+	//With the default propagation, light of the bright light travels further through the dim light's reach.
+	std::vector<Grid2D<ColorF>> computeOverlappingLights(Executor& executor, const std::function<void(Field&)>& configure)
+	{
+		Field field(FieldSize, GridUnitPixel);
+		field.setExecutor(executor);
+		field.clearLights();
+		configure(field);
+
+		field.addLight(Vec2(50.5, 50.5) * GridUnitPixel, ColorF(1.0, 1.0, 1.0), Vec2(0, 0), 1.0, 10.0);
+		field.addLight(Vec2(58.5, 50.5) * GridUnitPixel, ColorF(1.0, 1.0, 1.0), Vec2(0, 0), 0.05, 30.0);
+		field.addLight(Vec2(120.5, 50.5) * GridUnitPixel, HSV(200.0, 0.7, 1.0), Vec2(0, 0), 1.0, 12.0);
+		field.updateLighting();
+		return{ field.brightnessGrid() };
+	}
+
+	//ライトを1つずつ計算した明るさを、状態ごとにチャンネルの最大値で重ねる
+	//Combine brightness computed one light at a time by the maximum per channel in each state.
+	std::vector<Grid2D<ColorF>> computeStatesPerLight(Executor& executor, const std::function<void(Field&)>& configure, bool equalRanges)
+	{
+		std::vector<Grid2D<ColorF>> combined;
+		for (size_t i = 0; i < testLights(equalRanges).size(); ++i)
+		{
+			const auto states = computeStates(executor, configure, equalRanges, 1, static_cast<int>(i));
+			if (combined.empty())
+			{
+				combined = states;
+				continue;
+			}
+
+			for (size_t k = 0; k < states.size(); ++k)
+			{
+				for (size_t y = 0; y < states[k].height(); ++y)
+				{
+					for (size_t x = 0; x < states[k].width(); ++x)
+					{
+						ColorF& result = combined[k][y][x];
+						const ColorF& light = states[k][y][x];
+						result = ColorF(Max(result.r, light.r), Max(result.g, light.g), Max(result.b, light.b));
+					}
+				}
+			}
+		}
+		return combined;
+	}
+
+	//regionsをmargin[セル]だけ広げた範囲の外を黒にする
+	//Set cells outside the regions expanded by margin [cells] to black.
+	std::vector<Grid2D<ColorF>> restrictTo(std::vector<Grid2D<ColorF>> states, const std::vector<Rect>& regions, int margin)
+	{
+		for (auto& grid : states)
+		{
+			for (int y = 0; y < static_cast<int>(grid.height()); ++y)
+			{
+				for (int x = 0; x < static_cast<int>(grid.width()); ++x)
+				{
+					bool inside = false;
+					for (const auto& region : regions)
+					{
+						inside |= region.x - margin <= x && x < region.x + region.w + margin && region.y - margin <= y && y < region.y + region.h + margin;
+					}
+
+					if (!inside)
+					{
+						grid[y][x] = Palette::Black;
+					}
+				}
+			}
+		}
+		return states;
+	}
+
+	//referenceより暗い側と明るい側の最大の差がそれぞれbelowとaboveに収まるか調べる
+	//Check that the largest differences darker and brighter than reference stay within below and above.
+	bool check(const char* name, const std::vector<Grid2D<ColorF>>& states, const std::vector<Grid2D<ColorF>>& reference, double below, double above)
+	{
+		double darkest = 0.0;
+		double brightest = 0.0;
+		for (size_t i = 0; i < states.size(); ++i)
+		{
+			const auto& grid = states[i];
+			for (size_t y = 0; y < grid.height(); ++y)
+			{
+				for (size_t x = 0; x < grid.width(); ++x)
+				{
+					const ColorF& a = grid[y][x];
+					const ColorF& b = reference[i][y][x];
+					for (const double difference : { a.r - b.r, a.g - b.g, a.b - b.b })
+					{
+						darkest = Min(darkest, difference);
+						brightest = Max(brightest, difference);
+					}
+				}
+			}
+		}
+
+		const bool passed = -below <= darkest && brightest <= above;
+		std::printf("%-32s darker %.3g, brighter %.3g: %s\n", name, 0.0 - darkest, brightest, passed ? "ok" : "FAILED");
+		return passed;
+	}
+
+	//式を使って1回の走査で重ねた明るさを、セルごとのループで計算したものと比べる
+	//LODの段と動かない光を重ね、露出を掛けて壁を黒にする
+	//Compare brightness overlaid in a single pass with expressions against the same computed by a loop per cell.
+	//LOD levels and static light are overlaid, scaled by exposure, and walls are set to black.
+	bool checkComposition(Executor& executor)
+	{
+		Field field(FieldSize, GridUnitPixel);
+		field.setExecutor(executor);
+		field.clearLights();
+		buildMap(field);
+
+		Field::LightingLod lod;
+		lod.enabled = true;
+		lod.numLevels = 2;
+		lod.bandWidth = 12;
+		field.setLightingLod(lod);
+		field.setRegionsOfInterest({ Rect(50, 20, 30, 30) });
+
+		const Size size = field.gridSize();
+		Grid2D<ColorF> staticLight(size.x, size.y);
+		for (int y = 0; y < size.y; ++y)
+		{
+			for (int x = 0; x < size.x; ++x)
+			{
+				staticLight[y][x] = ColorF(0.3*x / size.x, 0.2, 0.3*y / size.y);
+			}
+		}
+		field.setStaticLightmap(staticLight);
+
+		for (const auto& light : testLights(false))
+		{
+			field.addLight(light.pos, light.color, Vec2(0, 0), 1.0, light.range);
+		}
+		field.updateLighting();
+
+		const double exposure = 1.5;
+		const ColorF black(Palette::Black);
+		std::vector<Grid2D<ColorF>> fused = { field.composeLightmap(exposure), Grid2D<ColorF>() };
+		fused[1] = Select(field.wallGrid(), black, Maximum(staticLight, field.brightnessGrid()) * exposure);
+
+		std::vector<Grid2D<ColorF>> loop(2, Grid2D<ColorF>(size.x, size.y));
+		for (int y = 0; y < size.y; ++y)
+		{
+			for (int x = 0; x < size.x; ++x)
+			{
+				const Point cell(x, y);
+				if (field.wallGrid()[cell] == Field::FieldWall())
+				{
+					loop[0][cell] = black;
+					loop[1][cell] = black;
+					continue;
+				}
+
+				const ColorF& s = staticLight[cell];
+				const ColorF lod = field.brightnessAt(cell);
+				const ColorF fine = field.brightnessGrid()[cell];
+				loop[0][cell] = ColorF(Max(s.r, lod.r)*exposure, Max(s.g, lod.g)*exposure, Max(s.b, lod.b)*exposure);
+				loop[1][cell] = ColorF(Max(s.r, fine.r)*exposure, Max(s.g, fine.g)*exposure, Max(s.b, fine.b)*exposure);
+			}
+		}
+
+		return check("composed lightmap", fused, loop, Exact, Exact);
+	}
+
+	//壁を置いたり取り除いたりしながら部屋分けを差分で更新し、毎回作り直した部屋分けと同じ分け方になるか調べる
+	//壁の線で部屋を2つに分けてから穴を開け直すことも繰り返す
+	//Update room labels incrementally while placing and removing walls, and check that they split cells the same way as labels rebuilt every time.
+	//Splitting a room in two with a line of walls and opening it again is repeated too.
+	bool checkRoomLabels()
+	{
+		const int width = 64;
+		const int height = 40;
+		Grid2D<char> walls(width, height, Field::FieldSpace());
+		RoomLabels labels;
+		labels.rebuild(walls, Field::FieldWall());
+
+		unsigned random = 12345;
+		const auto next = [&random](int limit)
+		{
+			random = random * 1103515245u + 12345u;
+			return static_cast<int>((random >> 16) % static_cast<unsigned>(limit));
+		};
+
+		int mismatches = 0;
+		for (int i = 0; i < 400; ++i)
+		{
+			Rect dirty;
+			char value;
+			if (i % 4 == 3)
+			{
+				//縦か横の壁の線で部屋を分ける。あとの空ける矩形が線に穴を開ける
+				//A vertical or horizontal line of walls splits rooms. Later rectangles of space open holes in it.
+				const bool vertical = next(2) == 0;
+				dirty = vertical ? Rect(next(width), 0, 1, height) : Rect(0, next(height), width, 1);
+				value = Field::FieldWall();
+			}
+			else
+			{
+				dirty = Rect(next(width), next(height), 1 + next(4), 1 + next(4));
+				value = next(3) == 0 ? Field::FieldWall() : Field::FieldSpace();
+			}
+
+			for (int y = dirty.y; y < Min(dirty.y + dirty.h, height); ++y)
+			{
+				for (int x = dirty.x; x < Min(dirty.x + dirty.w, width); ++x)
+				{
+					walls[y][x] = value;
+				}
+			}
+			labels.update(walls, Field::FieldWall(), dirty);
+
+			RoomLabels rebuilt;
+			rebuilt.rebuild(walls, Field::FieldWall());
+
+			//部屋の番号は違ってよいので、番号どうしが1対1に対応するか調べる
+			//Room numbers may differ, so check that they correspond one to one.
+			const int noRoom = RoomLabels::NoRoom;
+			std::vector<int> toRebuilt(labels.labelCount(), noRoom);
+			std::vector<int> toLabels(rebuilt.labelCount(), noRoom);
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					const int a = labels.room(Point(x, y));
+					const int b = rebuilt.room(Point(x, y));
+					if ((a == RoomLabels::NoRoom) != (b == RoomLabels::NoRoom))
+					{
+						++mismatches;
+						continue;
+					}
+
+					if (a == RoomLabels::NoRoom)
+					{
+						continue;
+					}
+
+					if (toRebuilt[a] == RoomLabels::NoRoom && toLabels[b] == RoomLabels::NoRoom)
+					{
+						toRebuilt[a] = b;
+						toLabels[b] = a;
+					}
+					else if (toRebuilt[a] != b || toLabels[b] != a)
+					{
+						++mismatches;
+					}
+
+					const Rect& bounds = labels.bounds(a);
+					if (x < bounds.x || bounds.x + bounds.w <= x || y < bounds.y || bounds.y + bounds.h <= y)
+					{
+						++mismatches;
+					}
+				}
+			}
+		}
+
+		const bool passed = mismatches == 0;
+		std::printf("%-32s mismatched cells %d: %s\n", "incremental room labels", mismatches, passed ? "ok" : "FAILED");
+		return passed;
+	}
+}
+
+int main()
+{
+	ThreadPool pool(4);
+	bool passed = true;
+
+	for (const bool equalRanges : { false, true })
+	{
+		std::printf("%s ranges\n", equalRanges ? "equal" : "mixed");
+
+		const auto reference = computeStates(pool, [](Field&) {}, equalRanges);
+		const auto sweep = computeStates(pool, [](Field& field) { field.setSweepPropagation(true); }, equalRanges);
+
+		//掃引は届く範囲の中の不動点なので、ステップ数で打ち切られる既定の伝播より暗くならない
+		//その場で更新すると光が1ステップで先へ進むので、既定の伝播と掃引の間に入る
+		//Sweeps reach the fixpoint within the reach, so they are never darker than the default propagation cut off by its step count.
+		//Updating in place lets light run ahead within a step, so the result lies between the default propagation and sweeps.
+		passed &= check("sweep", sweep, reference, Exact, 0.05);
+
+		//掃引は帯に分けて並列に走査するが、1本の帯で走査したものと一致する
+		//Sweeps run in parallel bands, but match sweeping a single band.
+		ThreadPool single(1);
+		passed &= check("sweep bands vs single band", sweep, computeStates(single, [](Field& field) { field.setSweepPropagation(true); }, equalRanges), Exact, Exact);
+		const auto redBlack = computeStates(pool, [](Field& field) { field.setRedBlackOrdering(true); }, equalRanges);
+		passed &= check("red-black vs jacobi", redBlack, reference, Exact, 0.05);
+		passed &= check("red-black vs sweep", redBlack, sweep, 0.05, Exact);
+
+		//ウォームスタートは前のフレームを修復しても、掃引で一から計算した不動点と一致する
+		//Warm start repairing the previous frame matches the fixpoint computed from scratch by sweeps.
+		passed &= check("warm start vs sweep", computeStates(pool, [](Field& field) { field.setWarmStart(true); }, equalRanges, 2), sweep, Exact, Exact);
+
+		//ベクトルの伝播はライトごとに計算するので、ほかのライトの範囲を伝わる光がなく、ライトを1つずつ計算したものの最大値と一致する
+		//減衰はユークリッド距離になるので、既定の伝播をライトごとに計算したものとは八角形の距離との差だけずれる
+		//Vector propagation computes lights one at a time, so no light travels through other lights' reach, and it matches the maximum of lights computed one at a time.
+		//It attenuates by the Euclidean distance, so it differs from the default propagation computed per light by the gap to the octagonal distance.
+		const auto vector = [](Field& field) { field.setVectorPropagation(true); };
+		const auto vectorStates = computeStates(pool, vector, equalRanges);
+		passed &= check("vector vs per-light maximum", vectorStates, computeStatesPerLight(pool, vector, equalRanges), Exact, Exact);
+		passed &= check("vector vs per-light default", vectorStates, computeStatesPerLight(pool, [](Field&) {}, equalRanges), 0.1, 0.1);
+
+		passed &= check("stamps", computeStates(pool, [](Field& field) { field.setLightStamps(true); }, equalRanges), reference, Exact, Exact);
+		if (!equalRanges)
+		{
+			const auto stamps = [](Field& field) { field.setLightStamps(true); };
+			passed &= check("stamps with overlapping lights", computeOverlappingLights(pool, stamps), computeOverlappingLights(pool, [](Field&) {}), Exact, Exact);
+		}
+		passed &= check("tile classification", computeStates(pool, [](Field& field) { field.setTileClassification(true); }, equalRanges), reference, Exact, Exact);
+
+		Field::TileSchedule schedule;
+		schedule.enabled = true;
+		passed &= check("tile schedule", computeStates(pool, [&schedule](Field& field) { field.setTileSchedule(schedule); }, equalRanges), reference, Exact, Exact);
+		passed &= check("red-black tile schedule", computeStates(pool, [&schedule](Field& field) { field.setRedBlackOrdering(true); field.setTileSchedule(schedule); }, equalRanges), redBlack, Exact, Exact);
+
+		//注目領域の中の明るさは、領域の外を計算しなくても変わらない
+		//Brightness inside the regions of interest does not change when the outside is not computed.
+		const std::vector<Rect> regions = { Rect(50, 20, 30, 30), Rect(100, 55, 25, 25) };
+		const auto interest = [&regions](Field& field) { field.setRegionsOfInterest(regions); };
+		passed &= check("regions of interest", restrictTo(computeStates(pool, interest, equalRanges), regions, 0), restrictTo(reference, regions, 0), Exact, Exact);
+
+		//LODを使っても注目領域の中は細かい格子のままで一致する。最初の帯は2倍の粗さの格子を補間するので、差はLodTolerance以内に収める
+		//With LOD, the regions of interest keep the fine grid and match. The first band interpolates a grid twice as coarse, so the difference is kept within LodTolerance.
+		Field::LightingLod lod;
+		lod.enabled = true;
+		lod.numLevels = 2;
+		lod.bandWidth = 12;
+		const auto lodStates = computeStates(pool, [&](Field& field) { interest(field); field.setLightingLod(lod); }, equalRanges, 1, -1, true);
+		const auto composedReference = computeStates(pool, [](Field&) {}, equalRanges, 1, -1, true);
+		passed &= check("lod inside regions", restrictTo(lodStates, regions, 0), restrictTo(composedReference, regions, 0), Exact, Exact);
+		passed &= check("lod first band", restrictTo(lodStates, regions, lod.bandWidth), restrictTo(composedReference, regions, lod.bandWidth), LodTolerance, LodTolerance);
+
+		//分割した計算は、完成するまで前に完成した明るさを表示するので、十分なフレーム数を進めてから比べる
+		//Sliced computation displays the previously completed brightness until it finishes, so enough frames are run before comparing.
+		passed &= check("propagation budget", computeStates(pool, [](Field& field) { field.setPropagationBudget(5000); }, equalRanges, 200), reference, Exact, Exact);
+
+		//入口をたどった範囲に限ると、ほかのライトの範囲を伝わる光がなくなるので暗くなるだけになる
+		//届く距離がそろっていても、既定の伝播では斜めに進んだ光が自分の円を出てほかのライトの円の中を進むので一致はしない
+		//Confining to rooms reached through portals removes light travelling through other lights' reach, so it can only be darker.
+		//Even with equal reach it does not match, as diagonal steps of the default propagation carry light out of its own disc into other lights' discs.
+		passed &= check("portal confinement", computeStates(pool, [](Field& field) { field.setPortalConfinement(true); }, equalRanges), reference, 0.05, Exact);
+	}
+
+	passed &= checkComposition(pool);
+	passed &= checkRoomLabels();
+
+	std::printf("%s\n", passed ? "all modes within tolerance" : "some modes out of tolerance");
+	return passed ? 0 : 1;
+}
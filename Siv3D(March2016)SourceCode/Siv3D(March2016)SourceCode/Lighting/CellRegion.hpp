@@ -0,0 +1,252 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "Geometry.hpp"
+
+namespace lighting
+{
+	//行ごとの区間 [begin, end) の集合で表したセルの領域
+	//Region of cells represented by a set of spans [begin, end) per row.
+	class CellRegion
+	{
+	public:
+
+		struct Span
+		{
+			int begin;
+			int end;
+		};
+
+		//行ごとの配列の容量は再利用する
+		//Capacity of each row's array is reused.
+		void clear(size_t width, size_t height)
+		{
+			m_width = width;
+			m_rows.resize(height);
+			for (auto& row : m_rows)
+			{
+				row.clear();
+			}
+		}
+
+		//追加した区間は重なっていてもよい。使う前にnormalizeする
+		//Added spans may overlap. Call normalize before use.
+		void addSpan(int y, int begin, int end)
+		{
+			if (y < 0 || static_cast<int>(m_rows.size()) <= y)
+			{
+				return;
+			}
+
+			begin = Max(begin, 0);
+			end = Min(end, static_cast<int>(m_width));
+			if (begin < end)
+			{
+				m_rows[y].push_back({ begin, end });
+			}
+		}
+
+		void addRect(const Rect& rect)
+		{
+			for (int y = rect.y; y < rect.y + rect.h; ++y)
+			{
+				addSpan(y, rect.x, rect.x + rect.w);
+			}
+		}
+
+		void addDisc(const Point& center, double radius)
+		{
+			const int r = static_cast<int>(Ceil(radius));
+			for (int dy = -r; dy <= r; ++dy)
+			{
+				const double half = radius*radius - dy*dy;
+				if (half < 0.0)
+				{
+					continue;
+				}
+
+				const int halfWidth = static_cast<int>(Sqrt(half));
+				addSpan(center.y + dy, center.x - halfWidth, center.x + halfWidth + 1);
+			}
+		}
+
+		//各行の区間を整列し、重なりや隣接する区間をまとめる
+		//Sort spans of each row and merge overlapping or adjacent ones.
+		void normalize()
+		{
+			for (auto& row : m_rows)
+			{
+				if (row.size() < 2)
+				{
+					continue;
+				}
+
+				std::sort(row.begin(), row.end(), [](const Span& a, const Span& b) { return a.begin < b.begin; });
+
+				size_t merged = 0;
+				for (size_t i = 1; i < row.size(); ++i)
+				{
+					if (row[i].begin <= row[merged].end)
+					{
+						row[merged].end = Max(row[merged].end, row[i].end);
+					}
+					else
+					{
+						row[++merged] = row[i];
+					}
+				}
+				row.resize(merged + 1);
+			}
+		}
+
+		//otherとの共通部分だけを残す（どちらもnormalize済みであること）
+		//Keep only the intersection with other (both must be normalized).
+		void intersect(const CellRegion& other)
+		{
+			for (size_t y = 0; y < m_rows.size(); ++y)
+			{
+				auto& row = m_rows[y];
+				if (other.m_rows.size() <= y)
+				{
+					row.clear();
+					continue;
+				}
+
+				const auto& mask = other.m_rows[y];
+				m_scratch.clear();
+				size_t i = 0;
+				size_t j = 0;
+				while (i < row.size() && j < mask.size())
+				{
+					const int begin = Max(row[i].begin, mask[j].begin);
+					const int end = Min(row[i].end, mask[j].end);
+					if (begin < end)
+					{
+						m_scratch.push_back({ begin, end });
+					}
+
+					if (row[i].end < mask[j].end)
+					{
+						++i;
+					}
+					else
+					{
+						++j;
+					}
+				}
+				row.swap(m_scratch);
+			}
+		}
+
+		bool contains(const Point& p)const
+		{
+			return containsSpan(p.y, p.x, p.x + 1);
+		}
+
+		//y行目の [begin, end) がひとつの区間に収まっているか
+		//Whether [begin, end) of row y fits in a single span.
+		bool containsSpan(int y, int begin, int end)const
+		{
+			if (y < 0 || static_cast<int>(m_rows.size()) <= y)
+			{
+				return false;
+			}
+
+			const auto& row = m_rows[y];
+			const auto it = std::upper_bound(row.begin(), row.end(), begin, [](int x, const Span& span) { return x < span.begin; });
+			return it != row.begin() && end <= (it - 1)->end;
+		}
+
+		//整列済みで重ならない区間を追加するときのために、1行だけ空にする
+		//Empty a single row, for adding sorted disjoint spans.
+		void clearRow(size_t y)
+		{
+			m_rows[y].clear();
+		}
+
+		const std::vector<Span>& row(size_t y)const
+		{
+			return m_rows[y];
+		}
+
+		//y行目の区間のうち [begin, end) に重なる部分を、func(begin, end) で左から順に列挙する
+		//Enumerate the parts of row y's spans overlapping [begin, end) from left to right with func(begin, end).
+		template<class Func>
+		void forEachSpanIn(size_t y, int begin, int end, Func func)const
+		{
+			const auto& row = m_rows[y];
+			auto it = std::lower_bound(row.begin(), row.end(), begin, [](const Span& span, int x) { return span.end <= x; });
+			for (; it != row.end() && it->begin < end; ++it)
+			{
+				func(Max(it->begin, begin), Min(it->end, end));
+			}
+		}
+
+		size_t height()const
+		{
+			return m_rows.size();
+		}
+
+		size_t area()const
+		{
+			size_t result = 0;
+			for (const auto& row : m_rows)
+			{
+				for (const auto& span : row)
+				{
+					result += span.end - span.begin;
+				}
+			}
+			return result;
+		}
+
+		//この領域に含まれ、otherに含まれない区間を列挙する（どちらもnormalize済みであること）
+		//Enumerate spans contained in this region but not in other (both must be normalized).
+		template<class Func>
+		void forEachDifference(const CellRegion& other, Func func)const
+		{
+			for (size_t y = 0; y < m_rows.size(); ++y)
+			{
+				const auto& excluded = y < other.m_rows.size() ? other.m_rows[y] : std::vector<Span>();
+				size_t j = 0;
+				for (const auto& span : m_rows[y])
+				{
+					int begin = span.begin;
+					while (j < excluded.size() && excluded[j].end <= begin)
+					{
+						++j;
+					}
+
+					for (size_t k = j; k < excluded.size() && excluded[k].begin < span.end; ++k)
+					{
+						if (begin < excluded[k].begin)
+						{
+							func(y, begin, excluded[k].begin);
+						}
+						begin = Max(begin, excluded[k].end);
+					}
+
+					if (begin < span.end)
+					{
+						func(y, begin, span.end);
+					}
+				}
+			}
+		}
+
+	private:
+
+		size_t m_width = 0;
+		std::vector<std::vector<Span>> m_rows;
+		std::vector<Span> m_scratch;
+	};
+}
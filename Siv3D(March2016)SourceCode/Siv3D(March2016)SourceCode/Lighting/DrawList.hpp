@@ -0,0 +1,89 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <vector>
+#include "RenderSink.hpp"
+
+namespace lighting
+{
+	//描画の呼び出しを記録し、後で別の描画先に同じ順に流す
+	//ワーカーのスレッドで記録し、描画APIを持つスレッドで流すときに使う
+	//Records drawing calls and later replays them to another sink in the same order.
+	//Used to record on a worker thread and replay on the thread owning the drawing API.
+	class DrawList : public RenderSink
+	{
+	public:
+
+		void drawCell(const Rect& rect, const ColorF& brightness) override
+		{
+			m_commands.push_back({ CommandKind::Cell, rect, Circle(), brightness });
+		}
+
+		void drawWall(const Rect& rect) override
+		{
+			m_commands.push_back({ CommandKind::Wall, rect, Circle(), ColorF() });
+		}
+
+		void drawLight(const Circle& light, const ColorF& color) override
+		{
+			m_commands.push_back({ CommandKind::Light, Rect(), light, color });
+		}
+
+		void replay(RenderSink& sink)const
+		{
+			for (const auto& command : m_commands)
+			{
+				switch (command.kind)
+				{
+				case CommandKind::Cell:
+					sink.drawCell(command.rect, command.color);
+					break;
+				case CommandKind::Wall:
+					sink.drawWall(command.rect);
+					break;
+				case CommandKind::Light:
+					sink.drawLight(command.circle, command.color);
+					break;
+				}
+			}
+		}
+
+		//記録を消す。確保したメモリは次のフレームのために残す
+		//Clears the records. Allocated memory is kept for the next frame.
+		void clear()
+		{
+			m_commands.clear();
+		}
+
+		size_t size()const
+		{
+			return m_commands.size();
+		}
+
+	private:
+
+		enum class CommandKind
+		{
+			Cell,
+			Wall,
+			Light,
+		};
+
+		struct Command
+		{
+			CommandKind kind;
+			Rect rect;
+			Circle circle;
+			ColorF color;
+		};
+
+		std::vector<Command> m_commands;
+	};
+}
@@ -0,0 +1,3457 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "CellRegion.hpp"
+#include "Geometry.hpp"
+#include "Grid2D.hpp"
+#include "GridAlgorithm.hpp"
+#include "GridExpression.hpp"
+#include "InputSource.hpp"
+#include "LightStamp.hpp"
+#include "Parallel.hpp"
+#include "PortalGraph.hpp"
+#include "RenderSink.hpp"
+#include "RoomLabels.hpp"
+#include "SignedWallDistance.hpp"
+#include "SpatialHash.hpp"
+
+namespace lighting
+{
+	//ライトを指すハンドル
+	//スロットが再利用されると世代が変わるので、削除済みのライトを指すハンドルは無効と判定できる
+	//Handle referring to a light.
+	//The generation changes when a slot is reused, so handles to removed lights are detected as invalid.
+	struct LightHandle
+	{
+		uint32 slot = 0;
+
+		//0は無効なハンドルを表す
+		//0 represents an invalid handle.
+		uint32 generation = 0;
+	};
+
+	class Field
+	{
+	public:
+
+		//ライト同士の相互作用の設定
+		//Settings of interaction between lights.
+		struct LightInteraction
+		{
+			bool enabled = false;
+
+			//この距離[px]より近いライト同士は反発する
+			//Lights closer than this distance [px] repel each other.
+			double radius = 64.0;
+
+			double repulsion = 2000.0;
+
+			double restitution = 0.5;
+		};
+
+		//注目領域から離れた場所の光を粗い格子で計算する設定
+		//Settings computing light far from the regions of interest on coarser grids.
+		struct LightingLod
+		{
+			bool enabled = false;
+
+			//粗い格子の段数。各段は前の段の2倍の粗さになる（2×, 4×, 8×...）
+			//Number of coarse levels. Each level is twice as coarse as the previous one (2x, 4x, 8x...).
+			int numLevels = 3;
+
+			//各段が受け持つ帯の幅[セル]。最後の段は残りすべてを受け持つ
+			//Width [cells] of the band each level covers. The last level covers all the rest.
+			int bandWidth = 16;
+		};
+
+		//入力が変わらないタイルの再計算を省く設定
+		//Settings skipping recomputation of tiles whose inputs are unchanged.
+		struct TileSchedule
+		{
+			bool enabled = false;
+
+			//タイルの一辺[セル]
+			//Side length of a tile [cells].
+			int tileSize = 16;
+
+			//変化のないタイルもこのフレーム数に一度は計算し直す。0なら変化があるまで計算しない
+			//Tiles without changes are still recomputed once every this many frames. 0 means never until something changes.
+			int refreshInterval = 0;
+		};
+
+		//fieldSize[px]はgridUnitPixelで割り切れること
+		//fieldSize [px] must be divisible by gridUnitPixel.
+		Field(const Size& fieldSize = Size(1280, 736), int gridUnitPixel = 32)
+			: m_fieldSize(fieldSize)
+			, m_isWall(m_fieldSize.x / gridUnitPixel, m_fieldSize.y / gridUnitPixel, FieldSpace())
+			, m_wallMask(m_fieldSize.x / gridUnitPixel, m_fieldSize.y / gridUnitPixel)
+			, m_tileClasses((m_fieldSize.x / gridUnitPixel + TileSize - 1) / TileSize, (m_fieldSize.y / gridUnitPixel + TileSize - 1) / TileSize, TileClass::Mixed)
+			, m_brightness(Grid2D<ColorF>(m_fieldSize.x / gridUnitPixel, m_fieldSize.y / gridUnitPixel, Palette::Black))
+		{
+			checkInitialValidness(gridUnitPixel);
+			m_openSpans.clear(m_isWall.width(), m_isWall.height());
+			updateOpenSpans(Rect(0, 0, static_cast<int>(m_isWall.width()), static_cast<int>(m_isWall.height())));
+			updateTileClasses(Rect(0, 0, static_cast<int>(m_isWall.width()), static_cast<int>(m_isWall.height())));
+			m_rooms.rebuild(m_isWall, FieldWall());
+			m_wallDistance.rebuild(m_isWall, FieldWall(), FieldSpace(), executor());
+			m_tileStepChanged.resize(m_tileClasses.width(), m_tileClasses.height());
+			m_tileStepChangedNext.resize(m_tileClasses.width(), m_tileClasses.height());
+			init();
+			collectLightSources();
+		}
+
+		//1フレームを順に進める。FramePipelineは同じ段階を別々のタスクとして実行する
+		//Advances one frame in sequence. FramePipeline runs the same stages as separate tasks.
+		void update(const InputSource& input = NullInput())
+		{
+			applyInput(input);
+			moveLights(input);
+			updateLighting();
+		}
+
+		//入力: カーソルのセルの壁を書き換える
+		//Input: rewrites the wall of the cell under the cursor.
+		void applyInput(const InputSource& input)
+		{
+			const auto mousePos = mouseGridPos(input);
+			if (m_isWall.isValid(mousePos))
+			{
+				if (input.isPressed(InputButton::PlaceWall))
+				{
+					editWalls().set(mousePos, FieldWall());
+				}
+				if (input.isPressed(InputButton::RemoveWall))
+				{
+					editWalls().set(mousePos, FieldSpace());
+				}
+			}
+		}
+
+		//物理: ライトを動かす。壁を読み、ライトの位置と速度だけを書く
+		//Physics: moves lights. Reads walls and writes only positions and velocities of lights.
+		void moveLights(const InputSource& input)
+		{
+			const double dt = 1.0 / 60.0;
+
+			if (m_lightInteraction.enabled)
+			{
+				interactLights(dt);
+			}
+
+			const double restitution = 0.5;
+			const int maxBounces = 4;
+			const double unit = gridUnitPixel();
+
+			for (size_t i = 0; i < m_lightPos.size(); ++i)
+			{
+				//減衰力
+				//damping force
+				m_velocity[i] *= 0.999;
+
+				const Vec2 toMouse = input.cursorPos() - m_lightPos[i].center;
+				if (input.isPressed(InputButton::DriveLights))
+				{
+					if (input.isPressed(InputButton::AttractLights))
+					{
+						m_velocity[i] += toMouse*0.5*dt;
+					}
+					else if (1.0 < toMouse.lengthSq())
+					{
+						m_velocity[i] += -toMouse / toMouse.lengthSq()*10000.0*dt;
+					}
+				}
+				else
+				{
+					m_velocity[i] += RandomVec2(1000.0, m_random)*dt;
+				}
+
+				//ライトと壁の衝突判定。移動の途中を半セルごとに壁までの符号付き距離で調べ、ライトの円が壁に触れたまま壁へ向かっていれば跳ね返す
+				//法線方向の速度だけを反転して弱め、接線方向はそのままにして壁に沿って滑らせる。角では跳ね返った先の壁も調べる
+				//壁に埋まったライトも壁へ向かう動きだけが跳ね返るので外へ出ていく
+				//Collision detection between lights and walls. The move is checked every half cell against the signed distance to walls, and a light whose circle touches a wall while heading into it bounces.
+				//Only the normal velocity is reversed and damped; the tangential velocity is kept so lights slide along walls. At corners, the wall the light bounces towards is checked as well.
+				//Lights buried in walls bounce only when heading further in, so they work their way out.
+				for (int bounce = 0; bounce < maxBounces && m_isWall.isValid(gridPos(m_lightPos[i].center.asPoint())); ++bounce)
+				{
+					const Vec2 move = m_velocity[i] * dt;
+					const int numSamples = move.lengthSq() <= 0.25*unit*unit ? 1 : 1 + static_cast<int>(move.length() / (unit*0.5));
+					bool reflects = false;
+					for (int k = 1; k <= numSamples && !reflects; ++k)
+					{
+						const auto wall = m_wallDistance.sample((m_lightPos[i].center + move*(1.0*k / numSamples)) / unit);
+						const double normalSpeed = m_velocity[i].dot(wall.gradient);
+						if (wall.distance*unit < m_lightPos[i].r && normalSpeed < 0.0)
+						{
+							m_velocity[i] -= wall.gradient*((1.0 + restitution)*normalSpeed / wall.gradient.lengthSq());
+							reflects = true;
+						}
+					}
+
+					if (!reflects)
+					{
+						break;
+					}
+				}
+
+				m_lightPos[i].center += m_velocity[i] * dt;
+			}
+		}
+
+		//ライトを動かさずに光だけを計算し直す。ライトの位置を外から与えるときに使う
+		//Recomputes only the light without moving lights. Used when light positions are given from outside.
+		void updateLighting()
+		{
+			collectLightSources();
+			propagateCollectedLight();
+		}
+
+		//注入: ライトの位置と色を光源の一覧と描画用に写し取る。この後はライトを動かしても光の計算と描画に影響しない
+		//Injection: copies positions and colours of lights into the list of sources and for drawing. Moving lights afterwards does not affect light computation or drawing.
+		void collectLightSources()
+		{
+			m_frameSources.clear();
+			for (size_t i = 0; i < m_lightPos.size(); ++i)
+			{
+				m_frameSources.push_back(lightSource(i));
+			}
+
+			m_drawnLightPos = m_lightPos;
+			m_drawnLightColor = m_lightColor;
+		}
+
+		//拡散: collectLightSourcesで写し取った光源から明るさを計算する
+		//Diffusion: computes brightness from the sources copied by collectLightSources.
+		void propagateCollectedLight()
+		{
+			if (m_warmStart)
+			{
+				repairLight();
+			}
+			else
+			{
+				resetBrightness();
+				propagateLight();
+			}
+		}
+
+		void draw(RenderSink& sink)const
+		{
+			for (size_t y = 0; y < m_isWall.height(); ++y)
+			{
+				for (size_t x = 0; x < m_isWall.width(); ++x)
+				{
+					const auto color = m_lodLevels.empty() ? m_brightness.read()[{x, y}] : brightnessAt({ x, y });
+
+					const Rect rect = gridRect({ x, y });
+
+					if (isWall({ x, y }))
+					{
+						sink.drawWall(rect);
+					}
+					else
+					{
+						sink.drawCell(rect, color);
+					}
+				}
+			}
+
+			for (size_t i = 0; i < m_drawnLightPos.size(); ++i)
+			{
+				sink.drawLight(m_drawnLightPos[i], m_drawnLightColor[i]);
+			}
+		}
+
+		static char FieldWall()
+		{
+			return static_cast<char>(true);
+		}
+
+		static char FieldSpace()
+		{
+			return static_cast<char>(false);
+		}
+
+		//ライトの追加・削除はどちらもO(1)で、reserveLightsした容量の範囲ではメモリ確保を行わない
+		//Adding and removing lights are both O(1), and no allocation happens within the capacity given to reserveLights.
+		void reserveLights(size_t capacity)
+		{
+			m_lightPos.reserve(capacity);
+			m_lightColor.reserve(capacity);
+			m_velocity.reserve(capacity);
+			m_lightIntensity.reserve(capacity);
+			m_lightRange.reserve(capacity);
+			m_lightSources.reserve(capacity);
+			m_lightSourceCell.reserve(capacity);
+			m_lightSourceColor.reserve(capacity);
+			m_lightSourceRange.reserve(capacity);
+			m_retiredSources.reserve(capacity);
+			m_lightSlot.reserve(capacity);
+			m_slotIndex.reserve(capacity);
+			m_slotGeneration.reserve(capacity);
+			m_freeSlots.reserve(capacity);
+			m_velocityDelta.reserve(capacity);
+			m_positionDelta.reserve(capacity);
+		}
+
+		//rangeは光が届く半径[セル]。それより外側は計算しない
+		//range is the radius [cells] the light reaches. Cells beyond it are not computed.
+		LightHandle addLight(const Vec2& pos, const ColorF& color, const Vec2& velocity = Vec2(0, 0), double intensity = 1.0, double range = 30.0)
+		{
+			uint32 slot;
+			if (m_freeSlots.empty())
+			{
+				slot = static_cast<uint32>(m_slotIndex.size());
+				m_slotIndex.push_back(0);
+				m_slotGeneration.push_back(1);
+			}
+			else
+			{
+				slot = m_freeSlots.back();
+				m_freeSlots.pop_back();
+			}
+
+			m_slotIndex[slot] = static_cast<uint32>(m_lightPos.size());
+			m_lightSlot.push_back(slot);
+			m_lightPos.emplace_back(pos, gridUnitPixel()*0.5);
+			m_lightColor.push_back(color);
+			m_velocity.push_back(velocity);
+			m_lightIntensity.push_back(intensity);
+			m_lightRange.push_back(range);
+			m_lightSourceCell.push_back(Point(0, 0));
+			m_lightSourceColor.push_back(Palette::Black);
+			m_lightSourceRange.push_back(-1.0);
+
+			LightHandle handle;
+			handle.slot = slot;
+			handle.generation = m_slotGeneration[slot];
+			return handle;
+		}
+
+		//末尾のライトを削除した位置へ移して配列を密に保つ
+		//Move the last light into the removed position to keep the arrays dense.
+		bool removeLight(const LightHandle& handle)
+		{
+			if (!isAlive(handle))
+			{
+				return false;
+			}
+
+			const uint32 index = m_slotIndex[handle.slot];
+			const uint32 last = static_cast<uint32>(m_lightPos.size() - 1);
+
+			//前のフレームまでに注入していた光は、次の修復で取り除く
+			//Light injected until the previous frame is removed in the next repair.
+			if (0.0 <= m_lightSourceRange[index])
+			{
+				m_retiredSources.push_back({ m_lightSourceCell[index], m_lightSourceRange[index] });
+			}
+
+			if (index != last)
+			{
+				m_lightPos[index] = m_lightPos[last];
+				m_lightColor[index] = m_lightColor[last];
+				m_velocity[index] = m_velocity[last];
+				m_lightIntensity[index] = m_lightIntensity[last];
+				m_lightRange[index] = m_lightRange[last];
+				m_lightSourceCell[index] = m_lightSourceCell[last];
+				m_lightSourceColor[index] = m_lightSourceColor[last];
+				m_lightSourceRange[index] = m_lightSourceRange[last];
+				m_lightSlot[index] = m_lightSlot[last];
+				m_slotIndex[m_lightSlot[index]] = index;
+			}
+
+			m_lightPos.pop_back();
+			m_lightColor.pop_back();
+			m_velocity.pop_back();
+			m_lightIntensity.pop_back();
+			m_lightRange.pop_back();
+			m_lightSourceCell.pop_back();
+			m_lightSourceColor.pop_back();
+			m_lightSourceRange.pop_back();
+			m_lightSlot.pop_back();
+
+			//世代0は無効なハンドル用に空けておく
+			//Generation 0 is kept for invalid handles.
+			uint32& generation = m_slotGeneration[handle.slot];
+			generation = generation + 1 == 0 ? 1 : generation + 1;
+			m_freeSlots.push_back(handle.slot);
+			return true;
+		}
+
+		bool isAlive(const LightHandle& handle)const
+		{
+			return handle.generation != 0
+				&& handle.slot < m_slotGeneration.size()
+				&& m_slotGeneration[handle.slot] == handle.generation;
+		}
+
+		void clearLights()
+		{
+			while (!m_lightSlot.empty())
+			{
+				LightHandle handle;
+				handle.slot = m_lightSlot.back();
+				handle.generation = m_slotGeneration[handle.slot];
+				removeLight(handle);
+			}
+		}
+
+		size_t numLights()const
+		{
+			return m_lightPos.size();
+		}
+
+		Vec2 lightPos(const LightHandle& handle)const
+		{
+			assert(isAlive(handle));
+			return m_lightPos[m_slotIndex[handle.slot]].center;
+		}
+
+		void setLightPos(const LightHandle& handle, const Vec2& pos)
+		{
+			assert(isAlive(handle));
+			m_lightPos[m_slotIndex[handle.slot]].center = pos;
+		}
+
+		void setLightColor(const LightHandle& handle, const ColorF& color)
+		{
+			assert(isAlive(handle));
+			m_lightColor[m_slotIndex[handle.slot]] = color;
+		}
+
+		void setLightVelocity(const LightHandle& handle, const Vec2& velocity)
+		{
+			assert(isAlive(handle));
+			m_velocity[m_slotIndex[handle.slot]] = velocity;
+		}
+
+		void setLightIntensity(const LightHandle& handle, double intensity)
+		{
+			assert(isAlive(handle));
+			m_lightIntensity[m_slotIndex[handle.slot]] = intensity;
+		}
+
+		void setLightRange(const LightHandle& handle, double range)
+		{
+			assert(isAlive(handle));
+			m_lightRange[m_slotIndex[handle.slot]] = range;
+		}
+
+		//前のフレームの明るさを引き継ぎ、変化した部分だけを修復するモード
+		//ステップ数の上限がないので、結果はsetSweepPropagationと同じく届く範囲の和集合の中での不動点になる
+		//短い光源の光も、ほかの光源の届く範囲の中ではその光源の到達距離を越えて広がる
+		//Mode that keeps the previous brightness and repairs only what changed.
+		//There is no limit on the number of steps, so the result is the fixpoint within the union of reach, as with setSweepPropagation.
+		//Light of a short-range source also spreads beyond its own reach inside the reach of other sources.
+		void setWarmStart(bool enabled)
+		{
+			if (enabled == m_warmStart)
+			{
+				return;
+			}
+
+			m_warmStart = enabled;
+			m_warmValid = false;
+			m_tilesValid = false;
+			m_slicing = false;
+			checkModeCombination();
+
+			for (int i = 0; i < 2; ++i)
+			{
+				Fill(cellPolicy(), m_brightness.write(), ColorF(Palette::Black));
+				m_brightness.flip();
+			}
+			m_litRegion.clear(m_isWall.width(), m_isWall.height());
+		}
+
+		bool isWarmStart()const
+		{
+			return m_warmStart;
+		}
+
+		//拡散とライトの物理の並列処理を実行する先。既定はDefaultExecutor
+		//executorはこのフィールドより長く生きること
+		//Where parallel work of diffusion and light physics is run. Defaults to DefaultExecutor.
+		//executor must outlive this field.
+		void setExecutor(Executor& executor)
+		{
+			m_executor = &executor;
+		}
+
+		Executor& executor()const
+		{
+			return m_executor ? *m_executor : DefaultExecutor();
+		}
+
+		//注目領域[セル]（ビューポートやAIの問い合わせ範囲など）
+		//光はこの領域を最大到達距離だけ広げた範囲でのみ計算するので、領域内の明るさは変わらずに計算量だけが減る
+		//空のときはフィールド全体が対象になる
+		//Regions of interest [cells] (viewports, AI query areas and so on).
+		//Light is computed only within these regions expanded by the maximum reach, so brightness inside is unchanged while work shrinks.
+		//When empty, the whole field is covered.
+		void setRegionsOfInterest(const std::vector<Rect>& regions)
+		{
+			m_regionsOfInterest = regions;
+			m_interestMargin = -1;
+			checkModeCombination();
+		}
+
+		const std::vector<Rect>& regionsOfInterest()const
+		{
+			return m_regionsOfInterest;
+		}
+
+		void setLightingLod(const LightingLod& lod)
+		{
+			m_lod = lod;
+			m_lodLevels.clear();
+			checkModeCombination();
+			if (!m_lod.enabled)
+			{
+				return;
+			}
+
+			m_lodLevels.resize(Max(m_lod.numLevels, 0));
+			for (size_t i = 0; i < m_lodLevels.size(); ++i)
+			{
+				auto& level = m_lodLevels[i];
+				level.scale = 2 << i;
+				const size_t width = (m_isWall.width() + level.scale - 1) / level.scale;
+				const size_t height = (m_isWall.height() + level.scale - 1) / level.scale;
+				level.isWall.resize(width, height, FieldSpace());
+				level.openSpans.clear(width, height);
+				level.brightness = DoubleBuffer<Grid2D<ColorF>>(Grid2D<ColorF>(width, height, Palette::Black));
+				level.brightness.setSingleBuffered(m_redBlack);
+				downsampleWalls(level, Rect(0, 0, static_cast<int>(m_isWall.width()), static_cast<int>(m_isWall.height())));
+			}
+		}
+
+		const LightingLod& lightingLod()const
+		{
+			return m_lod;
+		}
+
+		//光源や壁が変わったタイルだけを毎フレーム計算し、静かなタイルは前の値を使い続ける
+		//ウォームスタートが有効なときはそちらが優先される
+		//Only tiles whose sources or walls changed are computed every frame, and quiet tiles keep their previous values.
+		//Warm start takes precedence when enabled.
+		void setTileSchedule(const TileSchedule& schedule)
+		{
+			m_tileSchedule = schedule;
+			m_tilesValid = false;
+			checkModeCombination();
+
+			const size_t tileSize = Max(m_tileSchedule.tileSize, 1);
+			m_tileDirty.resize((m_isWall.width() + tileSize - 1) / tileSize, (m_isWall.height() + tileSize - 1) / tileSize, static_cast<char>(true));
+		}
+
+		const TileSchedule& tileSchedule()const
+		{
+			return m_tileSchedule;
+		}
+
+		//前回のupdateで計算し直したタイルの数
+		//Number of tiles recomputed in the last update.
+		size_t numUpdatedTiles()const
+		{
+			return m_numUpdatedTiles;
+		}
+
+		//1回のupdateで光の計算が更新するセル数の上限。0なら毎フレーム最後まで計算する
+		//上限があるときは計算を複数フレームに分けて進め、完成するまでは前に完成した明るさを表示する
+		//タイル単位の更新やウォームスタートが有効なときはそちらが優先される
+		//Upper limit of cell updates light computation performs per update. 0 computes to the end every frame.
+		//With a limit, the computation is spread over multiple frames, and the previously completed brightness is displayed until it finishes.
+		//Per-tile updates and warm start take precedence when enabled.
+		void setPropagationBudget(size_t cellUpdatesPerFrame)
+		{
+			m_propagationBudget = cellUpdatesPerFrame;
+			m_slicing = false;
+			m_slicedBrightness = DoubleBuffer<Grid2D<ColorF>>(Grid2D<ColorF>(m_isWall.width(), m_isWall.height(), Palette::Black));
+			m_slicedBrightness.setSingleBuffered(m_redBlack);
+			m_slicedLitRegion.clear(m_isWall.width(), m_isWall.height());
+			checkModeCombination();
+		}
+
+		size_t propagationBudget()const
+		{
+			return m_propagationBudget;
+		}
+
+		//明るさをその場で更新する。8近傍のステンシルなので、xとyの偶奇で4色に塗り分けて1色ずつ更新する
+		//同じ色のセル同士は隣り合わないので各色の中は並列に処理でき、明るさの格子は1枚で済む
+		//Update brightness in place. With the 8-neighbor stencil, cells are coloured in 4 classes by the parity of x and y and updated one colour at a time.
+		//Cells of the same colour are never adjacent, so each colour is processed in parallel, and a single brightness grid suffices.
+		void setRedBlackOrdering(bool enabled)
+		{
+			m_redBlack = enabled;
+			m_tilesValid = false;
+
+			m_brightness.setSingleBuffered(enabled);
+			m_slicedBrightness.setSingleBuffered(enabled);
+			for (auto& level : m_lodLevels)
+			{
+				level.brightness.setSingleBuffered(enabled);
+			}
+		}
+
+		bool isRedBlackOrdering()const
+		{
+			return m_redBlack;
+		}
+
+		//ステップを繰り返す代わりに、前向きと後ろ向きのラスタ走査を収束するまで繰り返して光を伝播させる
+		//壁のない場所では八角形距離の距離変換と同じで、走査1往復で届く距離によらずセルあたりO(1)で求まる
+		//ステップ数の上限がなくなるので、結果は届く範囲の中での不動点になる
+		//行を帯に分けて並列に走査する。帯の数は実行先のスレッド数で決まるが、結果は変わらない
+		//タイル単位の更新や複数フレームへの分割が有効なときはそちらが優先される
+		//Propagate light by forward and backward raster sweeps repeated until convergence instead of repeating steps.
+		//Without walls this equals an octagonal distance transform, and one round trip costs O(1) per cell regardless of reach.
+		//There is no limit on the number of steps, so the result is the fixpoint within the reach.
+		//Rows are split into bands swept in parallel. The number of bands depends on the threads of the executor, but the result does not.
+		//Per-tile updates and spreading over frames take precedence when enabled.
+		void setSweepPropagation(bool enabled)
+		{
+			m_sweep = enabled;
+		}
+
+		bool isSweepPropagation()const
+		{
+			return m_sweep;
+		}
+
+		//各セルが光源までのずれのベクトルを運び、ユークリッド距離で減衰させる（Danielssonの距離変換と同じ伝播）
+		//8近傍の減衰による八角形の形が円に近くなる。伝播は壁に遮られ、走査の繰り返しはsetSweepPropagationと同じ
+		//ライトごとに計算するので、各ライトの光は壁を回り込む道のりがそのライトの到達距離以内のセルにだけ届く
+		//ほかのライトの範囲を伝わって先へ届く光がなくなるので、既定の伝播より暗くなるところがある
+		//ウォームスタート、タイル単位の更新、複数フレームへの分割、模様の書き込み、部屋に限った計算、注目領域での粗い格子とは組み合わせられない
+		//Each cell carries the offset vector to its source and attenuates by the Euclidean distance (the same propagation as Danielsson's distance transform).
+		//The octagonal shapes of 8-neighbor attenuation become close to circles. Propagation is blocked by walls, and sweeps repeat as with setSweepPropagation.
+		//Lights are computed one at a time, so each light reaches only cells whose path around walls is within its own reach.
+		//Light no longer travels further through other lights' reach, so some places are darker than with the default propagation.
+		//Cannot be combined with warm start, per-tile updates, spreading over frames, stamps, portal confinement or coarse grids with regions of interest.
+		void setVectorPropagation(bool enabled)
+		{
+			m_vector = enabled;
+			if (!enabled)
+			{
+				m_vectorBuffers.clear();
+			}
+			checkModeCombination();
+		}
+
+		bool isVectorPropagation()const
+		{
+			return m_vector;
+		}
+
+		//届く範囲に壁がないライトは伝播させず、届く距離ごとに作っておいた明るさの模様を最大値で書き込む
+		//ほかのライトの範囲に接するライトは、光がその範囲を伝わってさらに先へ届くので伝播させる。そのため結果は既定の伝播と変わらない
+		//壁までの距離はライトの衝突判定と同じ格子を使う。注目領域があるときは使わない
+		//Lights with no walls within reach are not propagated; the brightness pattern prepared per reach is written by maximum instead.
+		//Lights touching another light's reach are still propagated, since their light travels further through that reach. So the result is unchanged from the default propagation.
+		//Distances to walls come from the same grid as light collision. Not used when there are regions of interest.
+		void setLightStamps(bool enabled)
+		{
+			m_stamps = enabled;
+			checkModeCombination();
+		}
+
+		bool isLightStamps()const
+		{
+			return m_stamps;
+		}
+
+		//細かい格子をタイル単位で進める。タイルは壁だけ・壁なし・混在に分けておき、壁だけのタイルと、前のステップで周りが変わらなかったタイルは飛ばす
+		//壁なしのタイルは壁を調べない計算を使う。閉じた部屋や暗い場所の多いマップで速くなる。その場で更新するときは使わない
+		//Advance the fine grid tile by tile. Tiles are classified as solid, open or mixed; solid tiles and tiles whose surroundings did not change in the previous step are skipped.
+		//Open tiles use the kernel without wall checks. Faster on maps with many sealed rooms or dark areas. Not used when updating in place.
+		void setTileClassification(bool enabled)
+		{
+			m_tileClassification = enabled;
+		}
+
+		bool isTileClassification()const
+		{
+			return m_tileClassification;
+		}
+
+		//細かい格子で各ライトを、部屋と入口をたどって届く距離以内に入れる部屋だけで計算する。壁で区切られた部屋と狭い入口の多いマップで速くなる
+		//ライトが止まった後にほかのライトの範囲を伝わる光はなくなる。掃引で計算するときは使わない
+		//Compute each light on the fine grid only in rooms it can enter within its reach by following portals. Faster on maps of rooms separated by walls with narrow doorways.
+		//Light no longer travels through other lights' reach after its own light has stopped. Not used when computing by sweeps.
+		void setPortalConfinement(bool enabled)
+		{
+			if (enabled && !m_portalConfinement)
+			{
+				m_portals.rebuild(m_isWall, FieldWall());
+			}
+			m_portalConfinement = enabled;
+			checkModeCombination();
+		}
+
+		bool isPortalConfinement()const
+		{
+			return m_portalConfinement;
+		}
+
+		//格子のセルの数
+		//Number of cells of the grid.
+		Size gridSize()const
+		{
+			return Size(m_isWall.width(), m_isWall.height());
+		}
+
+		//セルごとの壁の状態（FieldWallかFieldSpace）。壁はeditWallsで変更する
+		//Wall state per cell (FieldWall or FieldSpace). Walls are changed with editWalls.
+		const Grid2D<char>& wallGrid()const
+		{
+			return m_isWall;
+		}
+
+		//細かい格子の明るさ。次のupdateまで内容もアドレスも変わらない
+		//LODが有効なときは粗い段が受け持つセルが含まれないので、brightnessAtを使う
+		//Brightness of the fine grid. Neither contents nor address change until the next update.
+		//With LOD enabled it lacks cells covered by coarse levels, so use brightnessAt.
+		const Grid2D<ColorF>& brightnessGrid()const
+		{
+			return m_brightness.read();
+		}
+
+		//セルの明るさ。LODが有効なときは、注目領域からの距離に応じた段の格子から補間して求める
+		//Brightness of a cell. With LOD enabled, it is interpolated from the level chosen by the distance to the regions of interest.
+		ColorF brightnessAt(const Point& cell)const
+		{
+			if (!m_brightness.read().isValid(cell) || isWall(cell))
+			{
+				return Palette::Black;
+			}
+
+			const int level = lodLevelAt(cell);
+			if (level == 0)
+			{
+				return m_brightness.read()[cell];
+			}
+
+			return upsample(m_lodLevels[level - 1], cell);
+		}
+
+		//動かない光（焼き込んだ照明など）の明るさ。composeLightmapで動く光と大きい方を取って重ねる
+		//格子と大きさが違うグリッド（空のグリッドなど）を渡すと重ねなくなる
+		//Brightness of static light (such as baked lighting). composeLightmap overlays it with dynamic light by taking the larger one.
+		//Passing a grid whose size differs from the grid (such as an empty one) stops overlaying.
+		void setStaticLightmap(const Grid2D<ColorF>& lightmap)
+		{
+			m_staticLightmap = lightmap;
+		}
+
+		const Grid2D<ColorF>& staticLightmap()const
+		{
+			return m_staticLightmap;
+		}
+
+		//表示する明るさを全セルまとめて作る。LODの段を細かい格子に補間し、動かない光との大きい方にexposureを掛けて、壁を黒にする
+		//重ねる計算は式で書き、一時グリッドを作らずに1回の走査で済ませる。各セルはbrightnessAtを使って同じ計算をしたものと一致する
+		//返す参照は次のcomposeLightmapまで内容もアドレスも変わらない
+		//Build the displayed brightness of all cells at once. LOD levels are interpolated to the fine grid, the larger of it and static light is scaled by exposure, and walls are set to black.
+		//The overlay is written as an expression and done in a single pass without temporary grids. Each cell matches the same computation done with brightnessAt.
+		//Neither contents nor address of the returned reference change until the next composeLightmap.
+		const Grid2D<ColorF>& composeLightmap(double exposure)
+		{
+			const Grid2D<ColorF>& dynamic = upsampledBrightness();
+			const ColorF black(Palette::Black);
+			if (m_staticLightmap.width() == dynamic.width() && m_staticLightmap.height() == dynamic.height())
+			{
+				Assign(cellPolicy(), m_lightmap, Select(m_isWall, black, Maximum(m_staticLightmap, dynamic) * exposure));
+			}
+			else
+			{
+				Assign(cellPolicy(), m_lightmap, Select(m_isWall, black, dynamic * exposure));
+			}
+			return m_lightmap;
+		}
+
+		void setLightInteraction(const LightInteraction& interaction)
+		{
+			m_lightInteraction = interaction;
+		}
+
+		const LightInteraction& lightInteraction()const
+		{
+			return m_lightInteraction;
+		}
+
+		//壁の一括編集
+		//編集はビットマスク上でワード単位に行い、commit時に一度だけ通行判定と派生キャッシュを更新する
+		//Bulk wall editing.
+		//Edits are applied word-wise on the bit mask, and passability and derived caches are rebuilt once on commit.
+		class WallEdit
+		{
+		public:
+
+			explicit WallEdit(Field& field)
+				: m_field(&field)
+			{}
+
+			WallEdit(WallEdit&& other)
+				: m_field(other.m_field)
+				, m_dirtyBegin(other.m_dirtyBegin)
+				, m_dirtyEnd(other.m_dirtyEnd)
+			{
+				other.m_field = nullptr;
+			}
+
+			WallEdit(const WallEdit&) = delete;
+			WallEdit& operator=(const WallEdit&) = delete;
+
+			~WallEdit()
+			{
+				commit();
+			}
+
+			WallEdit& set(const Point& p, char value)
+			{
+				if (mask().isValid(p))
+				{
+					mask().set(p.x, p.y, value == FieldWall());
+					markDirty(p, p + Point(1, 1));
+				}
+				return *this;
+			}
+
+			WallEdit& rect(const Rect& rect, char value)
+			{
+				mask().fillRect(rect, value == FieldWall());
+				markDirty(Point(rect.x, rect.y), Point(rect.x + rect.w, rect.y + rect.h));
+				return *this;
+			}
+
+			//ブレゼンハムの直線
+			//Bresenham's line.
+			WallEdit& line(const Point& from, const Point& to, char value)
+			{
+				const int dx = Abs(to.x - from.x);
+				const int dy = -Abs(to.y - from.y);
+				const int sx = from.x < to.x ? 1 : -1;
+				const int sy = from.y < to.y ? 1 : -1;
+
+				Point p = from;
+				int error = dx + dy;
+				for (;;)
+				{
+					if (mask().isValid(p))
+					{
+						mask().set(p.x, p.y, value == FieldWall());
+					}
+					if (p == to)
+					{
+						break;
+					}
+
+					const int e2 = 2 * error;
+					if (dy <= e2)
+					{
+						error += dy;
+						p.x += sx;
+					}
+					if (e2 <= dx)
+					{
+						error += dx;
+						p.y += sy;
+					}
+				}
+
+				markDirty(Point(Min(from.x, to.x), Min(from.y, to.y)), Point(Max(from.x, to.x) + 1, Max(from.y, to.y) + 1));
+				return *this;
+			}
+
+			//塗りつぶした円を行ごとの区間として書き込む
+			//Write a filled circle as a span per row.
+			WallEdit& circle(const Point& center, int radius, char value)
+			{
+				for (int dy = -radius; dy <= radius; ++dy)
+				{
+					const int y = center.y + dy;
+					if (y < 0 || static_cast<int>(mask().height()) <= y)
+					{
+						continue;
+					}
+
+					const int halfWidth = static_cast<int>(Sqrt(1.0*radius*radius - dy*dy));
+					const int beginX = Max(center.x - halfWidth, 0);
+					const int endX = Min(center.x + halfWidth + 1, static_cast<int>(mask().width()));
+					if (beginX < endX)
+					{
+						mask().fillSpan(y, beginX, endX, value == FieldWall());
+					}
+				}
+
+				markDirty(center - Point(radius, radius), center + Point(radius + 1, radius + 1));
+				return *this;
+			}
+
+			//seedと同じ状態で4近傍につながる領域をvalueで塗りつぶす
+			//Fill the 4-connected region having the same state as seed with value.
+			WallEdit& floodFill(const Point& seed, char value)
+			{
+				if (!mask().isValid(seed))
+				{
+					return *this;
+				}
+
+				const bool target = mask()[seed];
+				const bool fill = value == FieldWall();
+				if (target == fill)
+				{
+					return *this;
+				}
+
+				const int width = static_cast<int>(mask().width());
+				const int height = static_cast<int>(mask().height());
+
+				std::vector<Point> stack(1, seed);
+				while (!stack.empty())
+				{
+					const Point p = stack.back();
+					stack.pop_back();
+
+					if (mask()[p] != target)
+					{
+						continue;
+					}
+
+					int left = p.x;
+					int right = p.x;
+					while (0 < left && mask().get(left - 1, p.y) == target)
+					{
+						--left;
+					}
+					while (right + 1 < width && mask().get(right + 1, p.y) == target)
+					{
+						++right;
+					}
+
+					mask().fillSpan(p.y, left, right + 1, fill);
+					markDirty(Point(left, p.y), Point(right + 1, p.y + 1));
+
+					for (int y = p.y - 1; y <= p.y + 1; y += 2)
+					{
+						if (y < 0 || height <= y)
+						{
+							continue;
+						}
+
+						bool inRun = false;
+						for (int x = left; x <= right; ++x)
+						{
+							const bool matches = mask().get(x, y) == target;
+							if (matches && !inRun)
+							{
+								stack.emplace_back(x, y);
+							}
+							inRun = matches;
+						}
+					}
+				}
+
+				return *this;
+			}
+
+			//patternの立っているビットの位置をvalueにする
+			//Set cells at set bits of pattern to value.
+			WallEdit& stamp(const BitGrid2D& pattern, const Point& pos, char value)
+			{
+				mask().blit(pattern, pos, value == FieldWall());
+				markDirty(pos, pos + Point(static_cast<int>(pattern.width()), static_cast<int>(pattern.height())));
+				return *this;
+			}
+
+			//ビットマスクの変更を通行判定に反映し、派生データを一度だけ無効化する
+			//Reflect the bit mask into passability and invalidate derived data only once.
+			void commit()
+			{
+				if (!m_field || m_dirtyEnd.x <= m_dirtyBegin.x || m_dirtyEnd.y <= m_dirtyBegin.y)
+				{
+					return;
+				}
+
+				const Rect dirty(m_dirtyBegin, m_dirtyEnd - m_dirtyBegin);
+				for (int y = m_dirtyBegin.y; y < m_dirtyEnd.y; ++y)
+				{
+					const auto line = m_field->m_isWall[y];
+					for (int x = m_dirtyBegin.x; x < m_dirtyEnd.x; ++x)
+					{
+						line[x] = mask().get(x, y) ? FieldWall() : FieldSpace();
+					}
+				}
+
+				m_dirtyBegin = m_dirtyEnd = Point(0, 0);
+				m_field->onWallsChanged(dirty);
+			}
+
+		private:
+
+			BitGrid2D& mask()
+			{
+				return m_field->m_wallMask;
+			}
+
+			void markDirty(const Point& begin, const Point& end)
+			{
+				const Point clippedBegin(Max(begin.x, 0), Max(begin.y, 0));
+				const Point clippedEnd(Min(end.x, static_cast<int>(mask().width())), Min(end.y, static_cast<int>(mask().height())));
+				if (clippedEnd.x <= clippedBegin.x || clippedEnd.y <= clippedBegin.y)
+				{
+					return;
+				}
+
+				if (m_dirtyEnd.x <= m_dirtyBegin.x || m_dirtyEnd.y <= m_dirtyBegin.y)
+				{
+					m_dirtyBegin = clippedBegin;
+					m_dirtyEnd = clippedEnd;
+					return;
+				}
+
+				m_dirtyBegin = Point(Min(m_dirtyBegin.x, clippedBegin.x), Min(m_dirtyBegin.y, clippedBegin.y));
+				m_dirtyEnd = Point(Max(m_dirtyEnd.x, clippedEnd.x), Max(m_dirtyEnd.y, clippedEnd.y));
+			}
+
+			Field* m_field;
+			Point m_dirtyBegin = Point(0, 0);
+			Point m_dirtyEnd = Point(0, 0);
+		};
+
+		//返したWallEditの破棄時（またはcommit時）に変更がまとめて反映される
+		//Changes are applied together when the returned WallEdit is destroyed (or committed).
+		WallEdit editWalls()
+		{
+			return WallEdit(*this);
+		}
+
+		//2セルを結ぶ線分上に壁がないか。線分が各行で通る区間を、壁のない区間の索引でまとめて調べる
+		//Whether no wall lies on the segment between two cells. The range the segment covers in each row is checked at once against the index of wall-free spans.
+		bool hasLineOfSight(const Point& from, const Point& to)const
+		{
+			const int dx = Abs(to.x - from.x);
+			const int dy = -Abs(to.y - from.y);
+			const int sx = from.x < to.x ? 1 : -1;
+			const int sy = from.y < to.y ? 1 : -1;
+
+			Point p = from;
+			int rowBegin = p.x;
+			int error = dx + dy;
+			for (;;)
+			{
+				if (p == to)
+				{
+					return m_openSpans.containsSpan(p.y, Min(rowBegin, p.x), Max(rowBegin, p.x) + 1);
+				}
+
+				const int e2 = 2 * error;
+				if (dy <= e2)
+				{
+					error += dy;
+					p.x += sx;
+				}
+				if (e2 <= dx)
+				{
+					//行が変わる前に、その行で通った区間を調べる
+					//Check the range covered in the row before moving to the next one.
+					const int rowEnd = dy <= e2 ? p.x - sx : p.x;
+					if (!m_openSpans.containsSpan(p.y, Min(rowBegin, rowEnd), Max(rowBegin, rowEnd) + 1))
+					{
+						return false;
+					}
+
+					error += dx;
+					p.y += sy;
+					rowBegin = p.x;
+				}
+			}
+		}
+
+		//範囲の中に壁がなく、すべてフィールドの内側にあるか
+		//Whether the area has no walls and lies entirely inside the field.
+		bool isAreaOpen(const Rect& area)const
+		{
+			for (int y = area.y; y < area.y + area.h; ++y)
+			{
+				if (!m_openSpans.containsSpan(y, area.x, area.x + area.w))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//壁が変更されるたびに増える。壁から作ったキャッシュの鮮度確認に使う
+		//Incremented on every wall change. Used to check freshness of caches built from walls.
+		uint64 wallRevision()const
+		{
+			return m_wallRevision;
+		}
+
+	private:
+
+		//粗い格子の一段
+		//One level of coarse grid.
+		struct LodLevel
+		{
+			int scale = 2;
+			Grid2D<char> isWall;
+			DoubleBuffer<Grid2D<ColorF>> brightness;
+			CellRegion openSpans;
+			CellRegion interestRegion;
+			CellRegion litRegion;
+			CellRegion activeRegion;
+			CellRegion nextRegion;
+		};
+
+		//光を伝播させる格子への参照。フィールドと同じ解像度のものと、LOD用の粗いものがある
+		//References to a grid light propagates over. There is one at field resolution and coarser ones for LOD.
+		struct LightLayer
+		{
+			int scale;
+			const Grid2D<char>& isWall;
+			const CellRegion& openSpans;
+			DoubleBuffer<Grid2D<ColorF>>& brightness;
+			const CellRegion& interestRegion;
+			CellRegion& litRegion;
+			CellRegion& activeRegion;
+			CellRegion& nextRegion;
+		};
+
+		//光の計算に使う光源の記録。colorは強さを掛けたもの
+		//Record of a source used by light computation. color is multiplied by the intensity.
+		struct LightSource
+		{
+			Point cell;
+			ColorF color;
+			double range;
+		};
+
+		//y行目の [begin, end) の区間
+		//Span [begin, end) of row y.
+		struct ReachSpan
+		{
+			int y;
+			int begin;
+			int end;
+		};
+
+		//途中で止めて再開できる光の計算の進み具合
+		//confinedのときは、k番目の光源が部屋と入口をたどって届く範囲を reachSpans[reachEnds[k - 1], reachEnds[k]) に持つ
+		//Progress of light computation that can be paused and resumed.
+		//When confined, holds the reach of the k-th source following rooms and portals in reachSpans[reachEnds[k - 1], reachEnds[k]).
+		struct PropagationState
+		{
+			size_t numActive = 0;
+			int step = 1;
+			int steps = 0;
+			size_t row = 0;
+			bool confined = false;
+			std::vector<ReachSpan> reachSpans;
+			std::vector<size_t> reachEnds;
+		};
+
+		//ずれの起点までのずれ（このセル - 起点）と、光源から起点まで壁の角を回り込んだ道のりを持つ。何も届いていなければ道のりは∞
+		//光はライトごとに運ぶので、どのチャンネルも同じ道を通る
+		//Holds the offset to its origin (this cell - origin) and the path length from the source to the origin around wall corners. The path length is infinity when nothing arrives.
+		//Light is carried one light at a time, so every channel follows the same path.
+		struct VectorLightCell
+		{
+			double pathLength = std::numeric_limits<double>::infinity();
+			Point offset = Point(0, 0);
+		};
+
+		//1つのライトのベクトルを運ぶ作業場所。セルはboundsの中だけを持ち、reachはboundsの中の届く範囲
+		//Work buffer carrying vectors of one light. Cells cover only bounds, and reach is the reach within bounds.
+		struct VectorLightBuffer
+		{
+			Rect bounds = Rect(0, 0, 0, 0);
+			CellRegion reach;
+			std::vector<VectorLightCell> cells;
+
+			VectorLightCell& operator[](const Point& p)
+			{
+				return cells[(p.y - bounds.y)*bounds.w + (p.x - bounds.x)];
+			}
+		};
+
+		//タイルの一辺[セル]
+		//Side length of a tile [cells].
+		static const int TileSize = 8;
+
+		//模様で書き込むライトと、ほかのライトの範囲との間に空ける距離[セル]
+		//Distance [cells] kept between a stamped light and the reach of other lights.
+		static const int StampMargin = 2;
+
+		//タイルの種類。壁を書き換えたときに周りのタイルだけ分類し直す
+		//Open: タイルとその周囲1セルに壁がなく、すべてフィールドの内側にある。壁を調べない計算を使える
+		//Solid: タイルのすべてのセルが壁。光は入らないので計算を省ける
+		//Kind of a tile. Only tiles around edited walls are reclassified.
+		//Open: neither the tile nor the 1-cell ring around it has walls, and all of it lies inside the field. The kernel without wall checks can be used.
+		//Solid: every cell of the tile is a wall. Light never enters, so computation can be skipped.
+		enum class TileClass : char
+		{
+			Mixed,
+			Open,
+			Solid,
+		};
+
+		LightLayer fineLayer()
+		{
+			return{ 1, m_isWall, m_openSpans, m_brightness, m_roomInterestRegion, m_litRegion, m_activeRegion, m_nextRegion };
+		}
+
+		static LightLayer lodLayer(LodLevel& level)
+		{
+			return{ level.scale, level.isWall, level.openSpans, level.brightness, level.interestRegion, level.litRegion, level.activeRegion, level.nextRegion };
+		}
+
+		//ベクトルの伝播は細かい格子を毎フレーム一から計算するときだけ使える。ほかのモードを黙って無視しないよう、組み合わせたら知らせる
+		//Vector propagation works only when the fine grid is computed from scratch every frame. Combining it with other modes is reported instead of silently ignoring them.
+		void checkModeCombination()const
+		{
+			const bool condition = !m_vector || (!m_warmStart && !m_tileSchedule.enabled && m_propagationBudget == 0 && !m_stamps && !m_portalConfinement && (!m_lod.enabled || m_regionsOfInterest.empty()));
+			if (!condition)
+			{
+				std::fputs("Field Mode Combination Failed : Vector Propagation Cannot Be Combined With Warm Start, Tile Schedule, Propagation Budget, Light Stamps, Portal Confinement Or Lighting LOD.\n", stderr);
+				assert(false);
+			}
+		}
+
+		void checkInitialValidness(int gridUnitPixel)const
+		{
+			const bool condition = m_fieldSize.x % gridUnitPixel == 0 && m_fieldSize.y % gridUnitPixel == 0;
+			if (!condition)
+			{
+				std::fputs("Field Class Initialization Failed : Field Resolution Cannot Be Divided By Cell Unit Size.\n", stderr);
+				assert(false);
+			}
+		}
+
+		void init()
+		{
+			{
+				const int width = static_cast<int>(m_isWall.width());
+				const int height = static_cast<int>(m_isWall.height());
+
+				auto edit = editWalls();
+				edit.rect(Rect(0, 0, width, height), FieldWall());
+				edit.rect(Rect(1, 1, width - 2, height - 2), FieldSpace());
+
+				//ランダムに壁を配置する
+				//Put blocks randomly.
+				//for (int y = 1; y + 1 < height; ++y) for (int x = 1; x + 1 < width; ++x) edit.set({ x, y }, RandomBool(0.3) ? FieldWall() : FieldSpace());
+			}
+
+			const int num = 8;
+			reserveLights(num);
+			for (int i = 0; i < num; ++i)
+			{
+				addLight(RandomVec2(RectF(0, 0, m_fieldSize).stretched(-gridUnitPixel()), m_random), HSV(120.0 + 30.0*i, 0.7, 1.0));
+			}
+		}
+
+		int gridUnitPixel()const
+		{
+			return m_fieldSize.y / m_isWall.height();
+		}
+
+		Rect gridRect(const Point& p)const
+		{
+			const int unitWidth = gridUnitPixel();
+			return Rect(unitWidth*p.x, unitWidth*p.y, unitWidth, unitWidth);
+		}
+
+		Rect fieldRect()const
+		{
+			return Rect(0, 0, m_fieldSize.x, m_fieldSize.y);
+		}
+
+		bool isWall(const Point& p)const
+		{
+			return m_isWall[p.y][p.x] == FieldWall();
+		}
+
+		void onWallsChanged(const Rect& dirty)
+		{
+			++m_wallRevision;
+
+			if (m_warmStart && m_warmValid)
+			{
+				m_pendingWallRects.push_back(dirty);
+			}
+
+			if (m_tileSchedule.enabled && m_tilesValid)
+			{
+				m_tileWallRects.push_back(dirty);
+			}
+
+			for (auto& level : m_lodLevels)
+			{
+				downsampleWalls(level, dirty);
+			}
+
+			updateOpenSpans(dirty);
+			updateTileClasses(dirty);
+			m_rooms.update(m_isWall, FieldWall(), dirty);
+			m_roomRegionValid = false;
+
+			m_wallDistance.update(m_isWall, FieldWall(), FieldSpace(), dirty, executor());
+
+			if (m_portalConfinement)
+			{
+				m_portals.update(m_isWall, FieldWall(), dirty);
+			}
+		}
+
+		//各行の壁のない区間の索引。変更のあった行だけ壁のビットマスクから作り直す
+		//Index of wall-free spans in each row. Only changed rows are rebuilt from the wall bit mask.
+		void updateOpenSpans(const Rect& dirty)
+		{
+			const int endY = Min(dirty.y + dirty.h, static_cast<int>(m_isWall.height()));
+			for (int y = Max(dirty.y, 0); y < endY; ++y)
+			{
+				m_openSpans.clearRow(y);
+				m_wallMask.forEachRun(y, false, [this, y](size_t begin, size_t end)
+				{
+					m_openSpans.addSpan(y, static_cast<int>(begin), static_cast<int>(end));
+				});
+			}
+		}
+
+		//dirtyとその周囲1セルに重なるタイルを分類し直す
+		//Reclassify tiles overlapping dirty and the 1-cell ring around it.
+		void updateTileClasses(const Rect& dirty)
+		{
+			const int width = static_cast<int>(m_isWall.width());
+			const int height = static_cast<int>(m_isWall.height());
+			const int beginX = Max(dirty.x - 1, 0) / TileSize;
+			const int beginY = Max(dirty.y - 1, 0) / TileSize;
+			const int endX = Min((dirty.x + dirty.w + TileSize) / TileSize, static_cast<int>(m_tileClasses.width()));
+			const int endY = Min((dirty.y + dirty.h + TileSize) / TileSize, static_cast<int>(m_tileClasses.height()));
+
+			for (int ty = beginY; ty < endY; ++ty)
+			{
+				for (int tx = beginX; tx < endX; ++tx)
+				{
+					const int x0 = tx*TileSize - 1;
+					const int y0 = ty*TileSize - 1;
+					const int x1 = (tx + 1)*TileSize + 1;
+					const int y1 = (ty + 1)*TileSize + 1;
+
+					bool open = 0 <= x0 && 0 <= y0 && x1 <= width && y1 <= height;
+					bool solid = true;
+					for (int y = Max(y0, 0); y < Min(y1, height); ++y)
+					{
+						for (int x = Max(x0, 0); x < Min(x1, width); ++x)
+						{
+							const bool inside = x0 < x && x < x1 - 1 && y0 < y && y < y1 - 1;
+							if (isWall({ x, y }))
+							{
+								open = false;
+							}
+							else if (inside)
+							{
+								solid = false;
+							}
+						}
+					}
+					m_tileClasses[ty][tx] = open ? TileClass::Open : solid ? TileClass::Solid : TileClass::Mixed;
+				}
+			}
+		}
+
+		//粗いセルは、覆う細かいセルに一つでも壁があれば壁とする（光が壁を漏れないように保守的にする）
+		//A coarse cell is a wall if any fine cell it covers is a wall (conservative so that light never leaks through walls).
+		void downsampleWalls(LodLevel& level, const Rect& dirty)
+		{
+			const int s = level.scale;
+			const int beginX = Max(dirty.x, 0) / s;
+			const int beginY = Max(dirty.y, 0) / s;
+			const int endX = Min((dirty.x + dirty.w + s - 1) / s, static_cast<int>(level.isWall.width()));
+			const int endY = Min((dirty.y + dirty.h + s - 1) / s, static_cast<int>(level.isWall.height()));
+
+			for (int cy = beginY; cy < endY; ++cy)
+			{
+				for (int cx = beginX; cx < endX; ++cx)
+				{
+					bool wall = false;
+					for (int y = cy*s; y < Min((cy + 1)*s, static_cast<int>(m_isWall.height())) && !wall; ++y)
+					{
+						for (int x = cx*s; x < Min((cx + 1)*s, static_cast<int>(m_isWall.width())); ++x)
+						{
+							if (isWall({ x, y }))
+							{
+								wall = true;
+								break;
+							}
+						}
+					}
+					level.isWall[cy][cx] = wall ? FieldWall() : FieldSpace();
+				}
+			}
+
+			for (int cy = beginY; cy < endY; ++cy)
+			{
+				level.openSpans.clearRow(cy);
+				const auto& line = level.isWall[cy];
+				for (int x = 0; x < static_cast<int>(line.size());)
+				{
+					if (line[x] == FieldWall())
+					{
+						++x;
+						continue;
+					}
+
+					const int begin = x;
+					while (x < static_cast<int>(line.size()) && line[x] != FieldWall())
+					{
+						++x;
+					}
+					level.openSpans.addSpan(cy, begin, x);
+				}
+			}
+		}
+
+		//注目領域の中は0、そこからbandWidthごとに1段ずつ粗くなる
+		//0 inside the regions of interest, one level coarser every bandWidth from there.
+		int lodLevelAt(const Point& cell)const
+		{
+			if (m_lodLevels.empty() || m_regionsOfInterest.empty())
+			{
+				return 0;
+			}
+
+			int distance = std::numeric_limits<int>::max();
+			for (const auto& region : m_regionsOfInterest)
+			{
+				const int dx = Max(Max(region.x - cell.x, cell.x - (region.x + region.w - 1)), 0);
+				const int dy = Max(Max(region.y - cell.y, cell.y - (region.y + region.h - 1)), 0);
+				distance = Min(distance, Max(dx, dy));
+			}
+
+			if (distance == 0)
+			{
+				return 0;
+			}
+
+			const int bandWidth = Max(m_lod.bandWidth, 1);
+			return Min((distance + bandWidth - 1) / bandWidth, static_cast<int>(m_lodLevels.size()));
+		}
+
+		//LODが有効なら、粗い段が受け持つセルを補間して細かい格子の明るさと合わせた格子を返す。無効なら細かい格子をそのまま返す
+		//If LOD is enabled, returns a grid combining the fine brightness with cells interpolated from the coarse levels. Otherwise returns the fine grid as it is.
+		const Grid2D<ColorF>& upsampledBrightness()
+		{
+			const auto& fine = m_brightness.read();
+			if (m_lodLevels.empty() || m_regionsOfInterest.empty())
+			{
+				return fine;
+			}
+
+			m_upsampledBrightness.resize(fine.width(), fine.height());
+			const size_t minRows = Max<size_t>(4096 / Max<size_t>(fine.width(), 1u), 1u);
+			executor().parallelFor(fine.height(), [this, &fine](size_t y)
+			{
+				auto row = m_upsampledBrightness[y];
+				for (size_t x = 0; x < fine.width(); ++x)
+				{
+					const Point cell(static_cast<int>(x), static_cast<int>(y));
+					const int level = lodLevelAt(cell);
+					row[x] = level == 0 ? fine[cell] : upsample(m_lodLevels[level - 1], cell);
+				}
+			}, minRows);
+			return m_upsampledBrightness;
+		}
+
+		//周囲4つの粗いセルから双線形補間する。壁のセルは重みに含めない
+		//Bilinear interpolation from the 4 surrounding coarse cells. Wall cells are excluded from the weights.
+		ColorF upsample(const LodLevel& level, const Point& cell)const
+		{
+			const auto& coarse = level.brightness.read();
+			const double u = (cell.x + 0.5) / level.scale - 0.5;
+			const double v = (cell.y + 0.5) / level.scale - 0.5;
+			const int x0 = static_cast<int>(Floor(u));
+			const int y0 = static_cast<int>(Floor(v));
+
+			ColorF sum(0.0, 0.0, 0.0, 1.0);
+			double totalWeight = 0.0;
+			for (int j = 0; j < 2; ++j)
+			{
+				for (int i = 0; i < 2; ++i)
+				{
+					const Point p(x0 + i, y0 + j);
+					if (!coarse.isValid(p) || level.isWall[p] == FieldWall())
+					{
+						continue;
+					}
+
+					const double weight = (i == 0 ? 1.0 - (u - x0) : u - x0)*(j == 0 ? 1.0 - (v - y0) : v - y0);
+					sum.r += coarse[p].r*weight;
+					sum.g += coarse[p].g*weight;
+					sum.b += coarse[p].b*weight;
+					totalWeight += weight;
+				}
+			}
+
+			if (totalWeight <= 0.0)
+			{
+				return coarse[{ cell.x / level.scale, cell.y / level.scale }];
+			}
+
+			return ColorF(sum.r / totalWeight, sum.g / totalWeight, sum.b / totalWeight);
+		}
+
+		void resetBrightness()
+		{
+			//タイル単位で更新するときは計算し直すタイルだけをpropagateTilesで消し、
+			//複数フレームに分けるときは表示中の明るさを残す
+			//When updating per tile, only recomputed tiles are cleared in propagateTiles,
+			//and when spreading over frames, the displayed brightness is kept.
+			if (!m_tileSchedule.enabled && m_propagationBudget == 0)
+			{
+				resetBrightness(fineLayer());
+			}
+			for (auto& level : m_lodLevels)
+			{
+				resetBrightness(lodLayer(level));
+			}
+		}
+
+		//前のフレームで光が届いた領域の外は常に黒なので、その領域だけを消す
+		//Cells outside the region lit in the previous frame are always black, so clear only that region.
+		void resetBrightness(const LightLayer& layer)const
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				Fill(cellPolicy(), layer.brightness.write(), layer.litRegion, ColorF(Palette::Black));
+				layer.brightness.flip();
+			}
+		}
+
+		//グリッド全体の処理に使う実行方針。セルの数が少なければタスクに分けない
+		//Execution policy for whole-grid operations. Not split into tasks when there are few cells.
+		execution::ParallelUnsequencedPolicy cellPolicy()const
+		{
+			return execution::par_unseq.on(executor());
+		}
+
+		int lightReach(size_t i, int scale = 1)const
+		{
+			return Max(static_cast<int>(Ceil(m_lightRange[i] / scale)), 0);
+		}
+
+		LightSource lightSource(size_t i)const
+		{
+			return{ gridPos(m_lightPos[i].center.asPoint()), m_lightColor[i] * m_lightIntensity[i], m_lightRange[i] };
+		}
+
+		static int sourceReach(const LightSource& source, int scale)
+		{
+			return Max(static_cast<int>(Ceil(source.range / scale)), 0);
+		}
+
+		static Point sourceCell(const LightSource& source, int scale)
+		{
+			return Point(static_cast<int>(Floor(1.0*source.cell.x / scale)), static_cast<int>(Floor(1.0*source.cell.y / scale)));
+		}
+
+		//sources[0, numActive) が届く範囲の和集合を作る。stateが部屋に限った範囲を持っていればそれを使う
+		//Build the union of reach of sources[0, numActive). Uses the reach confined to rooms when state holds it.
+		void buildReachRegion(const LightLayer& layer, const std::vector<LightSource>& sources, CellRegion& region, size_t numActive, const PropagationState* state = nullptr)const
+		{
+			region.clear(layer.isWall.width(), layer.isWall.height());
+			for (size_t k = 0; k < numActive; ++k)
+			{
+				if (state != nullptr && state->confined)
+				{
+					for (size_t i = k == 0 ? 0 : state->reachEnds[k - 1]; i < state->reachEnds[k]; ++i)
+					{
+						region.addSpan(state->reachSpans[i].y, state->reachSpans[i].begin, state->reachSpans[i].end);
+					}
+				}
+				else
+				{
+					region.addDisc(sourceCell(sources[k], layer.scale), sources[k].range / layer.scale);
+				}
+			}
+			region.normalize();
+			region.intersect(layer.interestRegion);
+		}
+
+		int maxLightReach()const
+		{
+			int result = 0;
+			for (size_t i = 0; i < m_lightRange.size(); ++i)
+			{
+				result = Max(result, lightReach(i));
+			}
+			return result;
+		}
+
+		//注目領域の外へmaxReachより遠いライトの光は届かないので、注目領域をmaxReachだけ広げた範囲で計算すれば十分
+		//Light from farther than maxReach outside the regions of interest cannot reach them, so computing within them expanded by maxReach is enough.
+		void updateInterestRegion(int maxReach)
+		{
+			if (m_interestMargin == maxReach)
+			{
+				return;
+			}
+
+			m_interestMargin = maxReach;
+			buildInterestRegion(m_interestRegion, 1, maxReach, false);
+			m_roomRegionValid = false;
+
+			//ウォームスタートの到達範囲やタイルの値は計算する範囲に依存するので作り直す
+			//Reach coverage of warm start and tile values depend on the computed range, so rebuild them.
+			m_warmValid = false;
+			m_tilesValid = false;
+		}
+
+		//壁で閉じた部屋に光源がなければ、その部屋のセルはずっと黒いので計算しない
+		//注目領域のうち、光源のある部屋の壁のない区間だけを細かい格子で計算する範囲にする
+		//光源のある部屋の集まりはフレームごとにライトの数だけで求め、それか壁か注目領域が変わったときだけ、光源のある部屋の矩形の中で範囲を作り直す
+		//Cells of a room closed by walls stay black when it holds no source, so they are not computed.
+		//Only the wall-free spans of rooms holding sources within the regions of interest become the range computed on the fine grid.
+		//The set of rooms holding sources is found each frame in time proportional to the lights, and only when it, the walls or the regions of interest change is the range rebuilt, within the rectangles of those rooms.
+		void updateRoomInterestRegion()
+		{
+			const int width = static_cast<int>(m_isWall.width());
+			m_litRooms.clear();
+			for (const auto& source : m_lightSources)
+			{
+				if (!m_isWall.isValid(source.cell))
+				{
+					continue;
+				}
+
+				if (!isWall(source.cell))
+				{
+					m_litRooms.push_back(m_rooms.room(source.cell));
+					continue;
+				}
+
+				//壁の中のライトも注入され、隣のセルを照らす。壁の中のセルは負の値で並べる
+				//A light inside a wall is still injected and lights the neighbouring cells. Cells inside walls are listed as negative values.
+				m_litRooms.push_back(-1 - (source.cell.y * width + source.cell.x));
+				for (const auto& direction : neighborDirections())
+				{
+					const Point neighbor = source.cell + direction;
+					if (m_isWall.isValid(neighbor) && !isWall(neighbor))
+					{
+						m_litRooms.push_back(m_rooms.room(neighbor));
+					}
+				}
+			}
+			std::sort(m_litRooms.begin(), m_litRooms.end());
+			m_litRooms.erase(std::unique(m_litRooms.begin(), m_litRooms.end()), m_litRooms.end());
+
+			if (m_roomRegionValid && m_litRooms == m_builtLitRooms)
+			{
+				return;
+			}
+
+			m_roomRegionValid = true;
+			m_builtLitRooms = m_litRooms;
+			m_roomInterestRegion.clear(m_isWall.width(), m_isWall.height());
+			for (const int room : m_litRooms)
+			{
+				if (room < 0)
+				{
+					const int cell = -1 - room;
+					m_roomInterestRegion.addSpan(cell / width, cell % width, cell % width + 1);
+					continue;
+				}
+
+				const Rect& bounds = m_rooms.bounds(room);
+				for (int y = bounds.y; y < bounds.y + bounds.h; ++y)
+				{
+					m_openSpans.forEachSpanIn(y, bounds.x, bounds.x + bounds.w, [&](int begin, int end)
+					{
+						if (m_rooms.room(Point(begin, y)) == room)
+						{
+							m_roomInterestRegion.addSpan(y, begin, end);
+						}
+					});
+				}
+			}
+			m_roomInterestRegion.normalize();
+			m_roomInterestRegion.intersect(m_interestRegion);
+		}
+
+		//注目領域をmargin[細かいセル]だけ広げた範囲を、scale倍の粗さのセルで作る
+		//Build the regions of interest expanded by margin [fine cells] in cells scale times coarser.
+		void buildInterestRegion(CellRegion& region, int scale, int margin, bool wholeField)const
+		{
+			const int width = static_cast<int>((m_isWall.width() + scale - 1) / scale);
+			const int height = static_cast<int>((m_isWall.height() + scale - 1) / scale);
+			region.clear(width, height);
+
+			if (m_regionsOfInterest.empty() || wholeField)
+			{
+				region.addRect(Rect(0, 0, width, height));
+			}
+			for (const auto& roi : m_regionsOfInterest)
+			{
+				const int beginX = static_cast<int>(Floor(1.0*(roi.x - margin) / scale));
+				const int beginY = static_cast<int>(Floor(1.0*(roi.y - margin) / scale));
+				const int endX = static_cast<int>(Ceil(1.0*(roi.x + roi.w + margin) / scale));
+				const int endY = static_cast<int>(Ceil(1.0*(roi.y + roi.h + margin) / scale));
+				region.addRect(Rect(beginX, beginY, endX - beginX, endY - beginY));
+			}
+			region.normalize();
+		}
+
+		void propagateLight()
+		{
+			m_lightSources = m_frameSources;
+			std::sort(m_lightSources.begin(), m_lightSources.end(), [](const LightSource& a, const LightSource& b)
+			{
+				return sourceReach(a, 1) > sourceReach(b, 1);
+			});
+
+			const int maxReach = m_lightSources.empty() ? 0 : sourceReach(m_lightSources.front(), 1);
+			updateInterestRegion(maxReach);
+			updateRoomInterestRegion();
+			if (m_tileSchedule.enabled)
+			{
+				propagateTiles(maxReach);
+			}
+			else if (0 < m_propagationBudget)
+			{
+				propagateSliced();
+			}
+			else if (m_vector)
+			{
+				propagateLightByVectors(fineLayer(), m_lightSources);
+			}
+			else if (m_sweep)
+			{
+				propagateLightBySweeps(fineLayer(), stampLights(fineLayer()), &m_tileClasses);
+				addStampedReach(fineLayer());
+			}
+			else
+			{
+				propagateLight(fineLayer(), stampLights(fineLayer()));
+				addStampedReach(fineLayer());
+			}
+
+			//注目領域がなければすべて細かい格子で計算済みなので、粗い格子は要らない
+			//Without regions of interest everything is already computed on the fine grid, so coarse grids are unnecessary.
+			if (m_regionsOfInterest.empty())
+			{
+				return;
+			}
+
+			for (size_t i = 0; i < m_lodLevels.size(); ++i)
+			{
+				auto& level = m_lodLevels[i];
+				const bool isLast = i + 1 == m_lodLevels.size();
+				buildInterestRegion(level.interestRegion, level.scale, static_cast<int>(i + 1)*Max(m_lod.bandWidth, 1) + maxReach, isLast);
+				if (m_sweep)
+				{
+					propagateLightBySweeps(lodLayer(level), m_lightSources, nullptr);
+				}
+				else
+				{
+					propagateLight(lodLayer(level), m_lightSources);
+				}
+			}
+		}
+
+		//届く範囲に壁がないライトを模様で両方のバッファに書き込み、残りの伝播させるライトを返す（届く距離の順は保つ）
+		//Write lights with no walls within reach to both buffers as stamps, and return the remaining lights to propagate (keeping the order by reach).
+		const std::vector<LightSource>& stampLights(const LightLayer& layer)
+		{
+			m_stampedSources.clear();
+			if (!m_stamps || !m_regionsOfInterest.empty())
+			{
+				return m_lightSources;
+			}
+
+			m_propagatedSources.clear();
+			m_stampCircles.clear();
+			double maxRange = 0.0;
+			for (const auto& source : m_lightSources)
+			{
+				m_stampCircles.emplace_back(Vec2(source.cell.x, source.cell.y), source.range);
+				maxRange = Max(maxRange, source.range);
+			}
+			if (!m_stampCircles.empty())
+			{
+				m_stampHash.build(m_stampCircles, 2.0*maxRange + StampMargin, executor());
+			}
+
+			for (size_t i = 0; i < m_lightSources.size(); ++i)
+			{
+				const auto& source = m_lightSources[i];
+				if (m_wallDistance.toWall().isDiscClear(source.cell, source.range) && isStampIsolated(i))
+				{
+					m_stampedSources.push_back(source);
+				}
+				else
+				{
+					m_propagatedSources.push_back(source);
+				}
+			}
+
+			for (const auto& source : m_stampedSources)
+			{
+				m_lightStamp.apply(layer.brightness.current(), source.cell, source.range, source.color);
+				if (!layer.brightness.isSingleBuffered())
+				{
+					m_lightStamp.apply(layer.brightness.write(), source.cell, source.range, source.color);
+				}
+			}
+
+			return m_propagatedSources;
+		}
+
+		//i番目のライトの範囲が、ほかのどのライトの範囲とも重ならず、隣り合うセルも持たないか
+		//2つの円のセルが隣り合うのは中心の距離が半径の和 + √2以下のときなので、余裕を見てStampMarginを足して比べる
+		//Whether the reach of the i-th light neither overlaps nor has cells adjacent to the reach of any other light.
+		//Cells of two discs are adjacent only when their centers are within the sum of radii + sqrt 2, so StampMargin is added for safety.
+		bool isStampIsolated(size_t i)const
+		{
+			const Circle& circle = m_stampCircles[i];
+			bool isolated = true;
+			m_stampHash.forEachNeighbor(circle.center, [&](uint32 j)
+			{
+				if (j == i)
+				{
+					return;
+				}
+
+				const Circle& other = m_stampCircles[j];
+				const double limit = circle.r + other.r + StampMargin;
+				if ((other.center - circle.center).lengthSq() <= limit*limit)
+				{
+					isolated = false;
+				}
+			});
+			return isolated;
+		}
+
+		//書き込んだ模様も次のフレームで消すように、光が届いた領域へ加える
+		//Add the written stamps to the lit region so that the next frame clears them too.
+		void addStampedReach(const LightLayer& layer)
+		{
+			if (m_stampedSources.empty())
+			{
+				return;
+			}
+
+			for (const auto& source : m_stampedSources)
+			{
+				layer.litRegion.addDisc(source.cell, source.range);
+			}
+			layer.litRegion.normalize();
+		}
+
+		//光は1ステップで1セル進むので、各ライトは自分の届く距離のステップ数だけ、届く範囲の中だけを更新すれば足りる
+		//届く距離の長い順にライトを並べ、短いライトが終わるたびに更新する領域を縮める
+		//Light advances one cell per step, so each light needs only as many steps as its reach, inside its reach.
+		//Lights are sorted by reach in descending order and the updated region shrinks as shorter lights finish.
+		void propagateLight(const LightLayer& layer, const std::vector<LightSource>& sources)
+		{
+			PropagationState state;
+			state.confined = m_portalConfinement && layer.scale == 1;
+			beginPropagation(layer, sources, state);
+			continuePropagation(layer, sources, state, 0);
+		}
+
+		void beginPropagation(const LightLayer& layer, const std::vector<LightSource>& sources, PropagationState& state)
+		{
+			state.numActive = sources.size();
+			state.step = 1;
+			state.steps = sources.empty() ? 0 : sourceReach(sources.front(), layer.scale);
+			state.row = 0;
+			if (state.confined)
+			{
+				buildConfinedReach(sources, state);
+			}
+			buildReachRegion(layer, sources, layer.litRegion, state.numActive, &state);
+			layer.activeRegion = layer.litRegion;
+
+			//計算する範囲の外にあるライトは注入しない
+			//Lights outside the computed region are not injected.
+			auto& brightness = layer.brightness.current();
+			for (const auto& source : sources)
+			{
+				const Point cell = sourceCell(source, layer.scale);
+				if (!layer.litRegion.contains(cell))
+				{
+					continue;
+				}
+
+				if (layer.scale == 1 || layer.isWall[cell] != FieldWall())
+				{
+					raise(brightness[cell], source.color);
+				}
+				else
+				{
+					injectAroundCoarseWall(layer, source, cell);
+				}
+			}
+
+			if (layer.brightness.isSingleBuffered())
+			{
+				spreadOutOfWalls(layer, sources);
+			}
+		}
+
+		//各ライトが部屋と入口をたどって入れる部屋に限った到達範囲を作る。光は1ステップでpropagationSpeedセルまで進む
+		//Build the reach of each light limited to rooms it can enter following portals. Light advances up to propagationSpeed cells per step.
+		void buildConfinedReach(const std::vector<LightSource>& sources, PropagationState& state)
+		{
+			state.reachSpans.clear();
+			state.reachEnds.clear();
+			for (const auto& source : sources)
+			{
+				m_portals.forEachReachSpan(source.cell, source.range, sourceReach(source, 1)*propagationSpeed(), [&state](int y, int begin, int end)
+				{
+					state.reachSpans.push_back({ y, begin, end });
+				});
+				state.reachEnds.push_back(state.reachSpans.size());
+			}
+		}
+
+		//更新したセルの数がbudgetに達するまで行単位で計算を進め、最後まで終わったらtrueを返す。budgetが0なら最後まで進める
+		//Advance the computation row by row until the number of updated cells reaches budget, and return true when finished. A budget of 0 runs to the end.
+		bool continuePropagation(const LightLayer& layer, const std::vector<LightSource>& sources, PropagationState& state, size_t budget)
+		{
+			size_t numUpdated = 0;
+			for (; state.step <= state.steps; ++state.step)
+			{
+				size_t nextActive = state.numActive;
+				while (0 < nextActive && sourceReach(sources[nextActive - 1], layer.scale) < state.step)
+				{
+					--nextActive;
+				}
+
+				if (nextActive != state.numActive)
+				{
+					state.numActive = nextActive;
+					buildReachRegion(layer, sources, layer.nextRegion, state.numActive, &state);
+
+					//更新されなくなるセルは両方のバッファで同じ値にしておく
+					//Cells no longer updated must hold the same value in both buffers.
+					if (!layer.brightness.isSingleBuffered())
+					{
+						layer.activeRegion.forEachDifference(layer.nextRegion, [&layer](size_t y, int begin, int end)
+						{
+							const auto& source = layer.brightness.read()[y];
+							std::copy(source.begin() + begin, source.begin() + end, layer.brightness.write()[y].begin() + begin);
+						});
+					}
+					std::swap(layer.activeRegion, layer.nextRegion);
+				}
+
+				//その場で更新するときは4色を順に1パスずつ処理する
+				//When updating in place, the 4 colours are processed one pass each in order.
+				const size_t numPasses = layer.brightness.isSingleBuffered() ? 4 : 1;
+				const size_t height = layer.activeRegion.height();
+				if (m_tileClassification && budget == 0 && layer.scale == 1 && numPasses == 1)
+				{
+					//どのタイルも変わらなければ、以降のステップも何も変えないので打ち切る。届く範囲は縮むだけで、新しい変化は生まれない
+					//If no tile changed, the remaining steps change nothing either, so stop. The reach region only shrinks and cannot create new changes.
+					if (!stepTiles(layer, state.step == 1))
+					{
+						layer.brightness.flip();
+						state.step = state.steps + 1;
+						break;
+					}
+				}
+				else if (budget == 0)
+				{
+					const size_t minRows = Max<size_t>(4096 / Max<size_t>(layer.isWall.width(), 1u), 1u);
+					for (size_t pass = 0; pass < numPasses; ++pass)
+					{
+						executor().parallelFor(height, [&layer, pass, numPasses](size_t y)
+						{
+							stepLightDiffusion(layer, layer.activeRegion, y, colourParity(pass, numPasses, y));
+						}, minRows);
+					}
+				}
+				else
+				{
+					for (; state.row < numPasses*height; ++state.row)
+					{
+						if (budget <= numUpdated)
+						{
+							return false;
+						}
+
+						const size_t y = state.row % height;
+						numUpdated += stepLightDiffusion(layer, layer.activeRegion, y, colourParity(state.row / height, numPasses, y));
+					}
+				}
+
+				layer.brightness.flip();
+				state.row = 0;
+			}
+
+			return true;
+		}
+
+		//壁の中に注入された光を、ステップで伝播させるときと同じく周囲に一度だけ広げてから消す
+		//その場で更新するときや掃引では、壁のセルが近傍に読まれる前に消されることがあるので先に済ませておく
+		//Spread light injected into a wall to its neighbors once and then clear it, as with stepped propagation.
+		//In-place updates and sweeps may clear the wall cell before its neighbors read it, so this is done up front.
+		static void spreadOutOfWalls(const LightLayer& layer, const std::vector<LightSource>& sources)
+		{
+			auto& brightness = layer.brightness.current();
+			for (const auto& source : sources)
+			{
+				const Point cell = sourceCell(source, layer.scale);
+				if (!layer.litRegion.contains(cell) || layer.isWall[cell] != FieldWall())
+				{
+					continue;
+				}
+
+				for (const auto& direction : neighborDirections())
+				{
+					const Point neighbor = cell + direction;
+					if (layer.litRegion.contains(neighbor) && layer.isWall[neighbor] != FieldWall() && !isDiagonalBlocked(layer.isWall, neighbor, -direction))
+					{
+						raise(brightness[neighbor], brightness[cell] * attenuation(direction, layer.scale));
+					}
+				}
+				brightness[cell] = Palette::Black;
+			}
+		}
+
+		//tileClassesで開けているタイルでは、壁と斜めの遮りを調べない速い計算を使う
+		//Tiles classified open in tileClasses use a fast kernel that checks neither walls nor diagonal blocking.
+		void propagateLightBySweeps(const LightLayer& layer, const std::vector<LightSource>& sources, const Grid2D<TileClass>* tileClasses)
+		{
+			PropagationState state;
+			beginPropagation(layer, sources, state);
+
+			spreadOutOfWalls(layer, sources);
+
+			//偶数番目の帯と奇数番目の帯を交互に並列に走査する。帯は隣の帯の端の行を読むだけなので、同時に走査する帯どうしは互いの書き込みを読まない
+			//明るさは増えるだけで、どの順に取り込んでも届く範囲の中の同じ不動点に収束するので、帯の数によらず1本で走査したものと一致する
+			//Even and odd bands are swept in parallel by turns. A band only reads the edge rows of neighboring bands, so bands swept at the same time never read each other's writes.
+			//Brightness only increases and converges to the same fixpoint within the reach in any order, so the result matches a single band regardless of the band count.
+			const size_t height = layer.litRegion.height();
+			const size_t minRows = Max<size_t>(4096 / Max<size_t>(layer.isWall.width(), 1u), 1u);
+			const size_t numBands = executor().chunkCount(height, minRows);
+			m_sweepBandChanged.assign(numBands, static_cast<char>(false));
+
+			for (;;)
+			{
+				bool changed = false;
+				for (size_t parity = 0; parity < 2; ++parity)
+				{
+					executor().parallelFor((numBands + 1 - parity) / 2, [this, &layer, tileClasses, height, numBands, parity](size_t i)
+					{
+						const size_t band = 2 * i + parity;
+						const int beginY = static_cast<int>(band*height / numBands);
+						const int endY = static_cast<int>((band + 1)*height / numBands);
+						const bool forward = sweepLight(layer, tileClasses, true, beginY, endY);
+						const bool backward = sweepLight(layer, tileClasses, false, beginY, endY);
+						m_sweepBandChanged[band] = forward || backward;
+					}, 1);
+				}
+
+				for (const char bandChanged : m_sweepBandChanged)
+				{
+					changed = changed || bandChanged != 0;
+				}
+				if (!changed)
+				{
+					break;
+				}
+			}
+		}
+
+		//行 [beginY, endY) を、forwardなら上の行から左から右へ、そうでなければ下の行から右から左へ走査し、処理済みの側の4近傍から光を取り込む。変化があればtrueを返す
+		//Sweep rows [beginY, endY) top to bottom and left to right if forward, otherwise bottom to top and right to left, pulling light from the 4 already visited neighbors. Returns true if anything changed.
+		static bool sweepLight(const LightLayer& layer, const Grid2D<TileClass>* tileClasses, bool forward, int beginY, int endY)
+		{
+			const int sign = forward ? 1 : -1;
+			const std::array<Point, 4> neighbors =
+			{
+				Point(-sign, 0), Point(-sign, -sign), Point(0, -sign), Point(sign, -sign)
+			};
+
+			std::array<double, 4> attenuations;
+			for (size_t i = 0; i < neighbors.size(); ++i)
+			{
+				attenuations[i] = attenuation(neighbors[i], layer.scale);
+			}
+
+			auto& brightness = layer.brightness.current();
+
+			bool changed = false;
+			for (int k = beginY; k < endY; ++k)
+			{
+				const int y = forward ? k : beginY + endY - 1 - k;
+				const auto& spans = layer.litRegion.row(y);
+				for (size_t j = 0; j < spans.size(); ++j)
+				{
+					const auto& span = spans[forward ? j : spans.size() - 1 - j];
+					for (int x = forward ? span.begin : span.end - 1; span.begin <= x && x < span.end; x += sign)
+					{
+						ColorF& cell = brightness[y][x];
+						const bool open = tileClasses != nullptr && (*tileClasses)[y / TileSize][x / TileSize] == TileClass::Open;
+						if (!open && layer.isWall[y][x] == FieldWall())
+						{
+							continue;
+						}
+
+						ColorF maxBrightness = cell;
+						for (size_t i = 0; i < neighbors.size(); ++i)
+						{
+							const Point sideCell = Point(x, y) + neighbors[i];
+							if (!open && (!brightness.isValid(sideCell) || isDiagonalBlocked(layer.isWall, { x, y }, neighbors[i])))
+							{
+								continue;
+							}
+
+							const ColorF& side = brightness[sideCell];
+							const double a = attenuations[i];
+							maxBrightness.r = Max(maxBrightness.r, side.r*a);
+							maxBrightness.g = Max(maxBrightness.g, side.g*a);
+							maxBrightness.b = Max(maxBrightness.b, side.b*a);
+						}
+
+						if (raise(cell, maxBrightness))
+						{
+							changed = true;
+						}
+					}
+				}
+			}
+
+			return changed;
+		}
+
+		//ライトごとに、その届く範囲の中でベクトルを運んで走査を収束するまで繰り返し、道のりから明るさへ直して最大値で重ねる
+		//セルはベクトルを1本しか持たないので、まとめて運ぶと明るく届く距離の短い光がほかの光を隠してしまう
+		//ライトどうしは互いを読まないので、ライトごとに並列に運ぶ。1つのライトの走査は直前に書いたセルを読むので、その中は逐次に進める
+		//明るさへ直す処理は行ごとに並列に行い、各行のセルは互いに独立に計算する
+		//For each light, carry vectors with sweeps repeated until convergence within its reach, then convert path lengths to brightness and combine by maximum.
+		//A cell holds only one vector, so carrying all lights together would let bright short-range light hide other light.
+		//Lights do not read each other, so they are carried in parallel, one light per task. A sweep of one light reads the cell written just before, so it runs sequentially.
+		//Conversion to brightness runs in parallel per row, and cells of a row are computed independently of each other.
+		void propagateLightByVectors(const LightLayer& layer, const std::vector<LightSource>& sources)
+		{
+			buildReachRegion(layer, sources, layer.litRegion, sources.size());
+
+			const double decay = -std::log(attenuation(Point(1, 0), layer.scale));
+			auto& brightness = layer.brightness.current();
+			const size_t minRows = Max<size_t>(4096 / Max<size_t>(brightness.width(), 1u), 1u);
+
+			//作業場所を使い回すため、ライトはスレッド数の数倍ずつまとめて処理する
+			//Lights are processed in batches of a few times the thread count so that work buffers are reused.
+			const size_t batchSize = Max<size_t>(executor().concurrency(), 1u) * 4;
+			if (m_vectorBuffers.size() < batchSize)
+			{
+				m_vectorBuffers.resize(batchSize);
+			}
+
+			for (size_t first = 0; first < sources.size(); first += batchSize)
+			{
+				const size_t count = Min(batchSize, sources.size() - first);
+				executor().parallelFor(count, [this, &layer, &sources, first](size_t i)
+				{
+					carryVectorLight(layer, sources[first + i], m_vectorBuffers[i]);
+				}, 1);
+
+				executor().parallelFor(brightness.height(), [this, &sources, &brightness, decay, first, count](size_t y)
+				{
+					auto row = brightness[y];
+					for (size_t i = 0; i < count; ++i)
+					{
+						const VectorLightBuffer& buffer = m_vectorBuffers[i];
+						const int localY = static_cast<int>(y) - buffer.bounds.y;
+						if (localY < 0 || buffer.bounds.h <= localY)
+						{
+							continue;
+						}
+
+						const ColorF color = sources[first + i].color;
+						const VectorLightCell* cells = buffer.cells.data() + localY*buffer.bounds.w;
+						for (const auto& span : buffer.reach.row(y))
+						{
+							LIGHTING_INDEPENDENT_LOOP
+							for (int x = span.begin; x < span.end; ++x)
+							{
+								const VectorLightCell& cell = cells[x - buffer.bounds.x];
+								if (cell.pathLength < std::numeric_limits<double>::infinity())
+								{
+									raise(row[x], color*Exp(-decay*vectorLightDistance(cell)));
+								}
+							}
+						}
+					}
+				}, minRows);
+			}
+		}
+
+		//1つのライトのベクトルをbufferの中で運ぶ。光源が光の届く領域の外にあれば、bufferの範囲は空になる
+		//Carry vectors of one light inside buffer. The bounds of buffer become empty when the source is outside the lit region.
+		void carryVectorLight(const LightLayer& layer, const LightSource& source, VectorLightBuffer& buffer)const
+		{
+			const Point cell = sourceCell(source, layer.scale);
+			buffer.bounds = Rect(0, 0, 0, 0);
+			if (!layer.litRegion.contains(cell))
+			{
+				return;
+			}
+
+			//届く範囲の円の外接矩形を1セル広げる。縁のセルの近傍も範囲の中にあるので、走査で位置を確かめずに読める
+			//The bounding box of the disc of reach is widened by one cell. Neighbors of edge cells are inside too, so sweeps read them without checking.
+			const double range = source.range / layer.scale;
+			const int radius = static_cast<int>(Ceil(range)) + 1;
+			buffer.bounds = Rect(cell.x - radius, cell.y - radius, 2 * radius + 1, 2 * radius + 1);
+			buffer.cells.assign(static_cast<size_t>(buffer.bounds.w*buffer.bounds.h), VectorLightCell());
+			buffer.reach.clear(layer.isWall.width(), layer.isWall.height());
+			buffer.reach.addDisc(cell, range);
+			buffer.reach.normalize();
+			buffer.reach.intersect(layer.interestRegion);
+
+			//壁の中の光源は、ステップで伝播させるときと同じく周囲に一度だけ広げる
+			//A source inside a wall spreads to its neighbors once, as with stepped propagation.
+			if (layer.isWall[cell] == FieldWall())
+			{
+				for (const auto& direction : neighborDirections())
+				{
+					const Point neighbor = cell + direction;
+					if (buffer.reach.contains(neighbor) && layer.isWall[neighbor] != FieldWall() && !isDiagonalBlocked(layer.isWall, neighbor, -direction))
+					{
+						seedVectorLight(buffer[neighbor], direction, range);
+					}
+				}
+			}
+			else
+			{
+				seedVectorLight(buffer[cell], Point(0, 0), range);
+			}
+
+			for (;;)
+			{
+				const bool forward = sweepVectors(layer, buffer, range, true);
+				const bool backward = sweepVectors(layer, buffer, range, false);
+				if (!forward && !backward)
+				{
+					break;
+				}
+			}
+		}
+
+		static void seedVectorLight(VectorLightCell& cell, const Point& offset, double range)
+		{
+			VectorLightCell seed;
+			seed.pathLength = 0.0;
+			seed.offset = offset;
+
+			const double distance = vectorLightDistance(seed);
+			if (distance <= range && distance < vectorLightDistance(cell))
+			{
+				cell = seed;
+			}
+		}
+
+		//光源からこのセルまでの道のり
+		//Path length from the source to this cell.
+		static double vectorLightDistance(const VectorLightCell& cell)
+		{
+			return cell.pathLength + Sqrt(cell.offset.x*cell.offset.x + cell.offset.y*cell.offset.y);
+		}
+
+		//届く範囲の中をsweepLightと同じ順に走査し、処理済みの側の4近傍のベクトルを1セル延ばしたものが近ければ置き換える。変化があればtrueを返す
+		//道のりがrangeを越える先へは延ばさない
+		//Sweep the reach in the same order as sweepLight, replacing vectors by those of the 4 visited neighbors extended by one cell when closer. Returns true if anything changed.
+		//Vectors are not extended where the path length would exceed range.
+		bool sweepVectors(const LightLayer& layer, VectorLightBuffer& buffer, double range, bool forward)const
+		{
+			const int sign = forward ? 1 : -1;
+			const std::array<Point, 4> neighbors =
+			{
+				Point(-sign, 0), Point(-sign, -sign), Point(0, -sign), Point(sign, -sign)
+			};
+
+			const CellRegion& region = buffer.reach;
+			const int beginY = Max(buffer.bounds.y, 0);
+			const int endY = Min(buffer.bounds.y + buffer.bounds.h, static_cast<int>(region.height()));
+
+			bool changed = false;
+			for (int k = beginY; k < endY; ++k)
+			{
+				const int y = forward ? k : beginY + endY - 1 - k;
+				const auto& spans = region.row(y);
+				for (size_t j = 0; j < spans.size(); ++j)
+				{
+					const auto& span = spans[forward ? j : spans.size() - 1 - j];
+					for (int x = forward ? span.begin : span.end - 1; span.begin <= x && x < span.end; x += sign)
+					{
+						const bool open = m_tileClasses[y / TileSize][x / TileSize] == TileClass::Open;
+						if (!open && layer.isWall[y][x] == FieldWall())
+						{
+							continue;
+						}
+
+						VectorLightCell& cell = buffer[Point(x, y)];
+						double distance = vectorLightDistance(cell);
+
+						for (const auto& direction : neighbors)
+						{
+							const Point sideCell = Point(x, y) + direction;
+							if (!open && (!layer.isWall.isValid(sideCell) || isDiagonalBlocked(layer.isWall, { x, y }, direction)))
+							{
+								continue;
+							}
+
+							const VectorLightCell& side = buffer[sideCell];
+							if (!(side.pathLength < std::numeric_limits<double>::infinity()))
+							{
+								continue;
+							}
+
+							//光源から真っすぐ離れる向き（ずれとの角度が45°以内）にしか延ばさない。それ以外は隣のセルを起点とみなし直し、光が壁の角を回り込むときの距離を道のりにする
+							//Extend only away from the origin (within 45° of the offset). Otherwise the neighbor is treated as the origin, so light turning around a wall corner is attenuated by the path length.
+							Point offset = side.offset - direction;
+							double pathLength = side.pathLength;
+							const int stepLengthSq = direction.x*direction.x + direction.y*direction.y;
+							const int dot = -(offset.x*direction.x + offset.y*direction.y);
+							if (dot <= 0 || 2 * dot*dot < (offset.x*offset.x + offset.y*offset.y)*stepLengthSq)
+							{
+								pathLength = vectorLightDistance(side);
+								offset = -direction;
+							}
+
+							const double candidate = pathLength + Sqrt(offset.x*offset.x + offset.y*offset.y);
+							if (candidate <= range && candidate < distance)
+							{
+								distance = candidate;
+								cell.pathLength = pathLength;
+								cell.offset = offset;
+								changed = true;
+							}
+						}
+					}
+				}
+			}
+
+			return changed;
+		}
+
+		//予算の範囲で計算を進め、終わったら表示する明るさと入れ替える
+		//途中の状態は次のフレームへ持ち越し、その間は最後に完成した明るさを表示し続ける
+		//Advance the computation within the budget and swap it with the displayed brightness when finished.
+		//The state in progress is carried over to the next frame, and the last completed brightness keeps being displayed meanwhile.
+		void propagateSliced()
+		{
+			const LightLayer layer = { 1, m_isWall, m_openSpans, m_slicedBrightness, m_slicedInterestRegion, m_slicedLitRegion, m_slicedActiveRegion, m_slicedNextRegion };
+			if (!m_slicing)
+			{
+				m_slicedSources = m_lightSources;
+				m_slicedInterestRegion = m_roomInterestRegion;
+				m_slicedState.confined = m_portalConfinement;
+				resetBrightness(layer);
+				beginPropagation(layer, m_slicedSources, m_slicedState);
+				m_slicing = true;
+			}
+
+			if (continuePropagation(layer, m_slicedSources, m_slicedState, m_propagationBudget))
+			{
+				std::swap(m_brightness, m_slicedBrightness);
+				std::swap(m_litRegion, m_slicedLitRegion);
+				m_slicing = false;
+			}
+		}
+
+		//セルの明るさは最大到達距離より近くの光源と壁だけで決まるので、変化をその距離だけ広げた範囲のタイルを計算し直せば足りる
+		//計算し直さないタイルは前の値のまま、計算し直すタイルの境界として読まれる
+		//A cell's brightness depends only on sources and walls closer than the maximum reach, so recomputing tiles within that distance of a change is enough.
+		//Tiles not recomputed keep their previous values and are read as the boundary of recomputed ones.
+		void propagateTiles(int maxReach)
+		{
+			const int tileSize = Max(m_tileSchedule.tileSize, 1);
+			const int margin = Max(maxReach, m_tileMargin)*propagationSpeed() + 1;
+			m_tileMargin = maxReach;
+
+			m_tileSourcesNext = m_frameSources;
+
+			if (!m_tilesValid)
+			{
+				m_tileDirty.reset(static_cast<char>(true));
+				m_tilesValid = true;
+			}
+			else
+			{
+				//添字がずれたライトは、前後どちらの位置も変化として扱う
+				//Lights whose index shifted are treated as changes at both old and new positions.
+				for (size_t i = 0; i < Max(m_tileSources.size(), m_tileSourcesNext.size()); ++i)
+				{
+					const bool hasOld = i < m_tileSources.size();
+					const bool hasNew = i < m_tileSourcesNext.size();
+					if (hasOld && hasNew && isSameSource(m_tileSources[i], m_tileSourcesNext[i]))
+					{
+						continue;
+					}
+					if (hasOld)
+					{
+						markDirtyTiles(m_tileSources[i].cell, static_cast<int>(Ceil(m_tileSources[i].range)) + margin);
+					}
+					if (hasNew)
+					{
+						markDirtyTiles(m_tileSourcesNext[i].cell, static_cast<int>(Ceil(m_tileSourcesNext[i].range)) + margin);
+					}
+				}
+
+				for (const auto& rect : m_tileWallRects)
+				{
+					markDirtyTiles(Rect(rect.x - margin, rect.y - margin, rect.w + 2 * margin, rect.h + 2 * margin));
+				}
+			}
+			m_tileWallRects.clear();
+			std::swap(m_tileSources, m_tileSourcesNext);
+
+			if (0 < m_tileSchedule.refreshInterval)
+			{
+				for (size_t ty = 0; ty < m_tileDirty.height(); ++ty)
+				{
+					for (size_t tx = 0; tx < m_tileDirty.width(); ++tx)
+					{
+						if ((ty*m_tileDirty.width() + tx + m_tileFrame) % m_tileSchedule.refreshInterval == 0)
+						{
+							m_tileDirty[ty][tx] = static_cast<char>(true);
+						}
+					}
+				}
+			}
+			++m_tileFrame;
+
+			//計算し直すタイルと、それを光が進める距離だけ広げた計算範囲を作る
+			//Build the tiles to recompute, and the computed range expanding them by the distance light can advance.
+			const int halo = maxReach*propagationSpeed();
+			m_tileRegion.clear(m_isWall.width(), m_isWall.height());
+			m_tileInterestRegion.clear(m_isWall.width(), m_isWall.height());
+			m_numUpdatedTiles = 0;
+			for (size_t ty = 0; ty < m_tileDirty.height(); ++ty)
+			{
+				for (size_t tx = 0; tx < m_tileDirty.width(); ++tx)
+				{
+					if (!m_tileDirty[ty][tx])
+					{
+						continue;
+					}
+
+					m_tileDirty[ty][tx] = static_cast<char>(false);
+					++m_numUpdatedTiles;
+
+					const Rect tile(static_cast<int>(tx)*tileSize, static_cast<int>(ty)*tileSize, tileSize, tileSize);
+					m_tileRegion.addRect(tile);
+					m_tileInterestRegion.addRect(Rect(tile.x - halo, tile.y - halo, tile.w + 2 * halo, tile.h + 2 * halo));
+				}
+			}
+			m_tileRegion.normalize();
+			m_tileInterestRegion.normalize();
+			m_tileInterestRegion.intersect(m_interestRegion);
+
+			//光はmaxReachステップ分しか進まないので、計算範囲の外は計算し直すタイルに影響しない
+			//広げた部分は正しい値にならないので、退避しておいて最後に戻す
+			//Light advances only maxReach steps, so nothing outside the computed range affects the recomputed tiles.
+			//The expanded part does not get correct values, so it is saved and restored at the end.
+			m_tileHalo.clear();
+			m_tileInterestRegion.forEachDifference(m_tileRegion, [this](size_t y, int begin, int end)
+			{
+				const auto& row = m_brightness.read()[y];
+				m_tileHalo.insert(m_tileHalo.end(), row.begin() + begin, row.begin() + end);
+			});
+
+			for (int i = 0; i < 2; ++i)
+			{
+				Fill(cellPolicy(), m_brightness.write(), m_tileRegion, ColorF(Palette::Black));
+				Fill(cellPolicy(), m_brightness.write(), m_tileInterestRegion, ColorF(Palette::Black));
+				m_brightness.flip();
+			}
+
+			propagateLight({ 1, m_isWall, m_openSpans, m_brightness, m_tileInterestRegion, m_tileLitRegion, m_tileActiveRegion, m_tileNextRegion }, m_lightSources);
+
+			//戻した値と計算し直した値を、両方のバッファで同じにしておく
+			//Make restored and recomputed values the same in both buffers.
+			size_t haloIndex = 0;
+			m_tileInterestRegion.forEachDifference(m_tileRegion, [this, &haloIndex](size_t y, int begin, int end)
+			{
+				std::copy(m_tileHalo.begin() + haloIndex, m_tileHalo.begin() + haloIndex + (end - begin), m_brightness.current()[y].begin() + begin);
+				haloIndex += end - begin;
+			});
+			if (!m_brightness.isSingleBuffered())
+			{
+				Transform(cellPolicy(), m_brightness.read(), m_brightness.write(), m_tileInterestRegion, [](const ColorF& color) { return color; });
+			}
+
+			//タイル単位の更新をやめたときにresetBrightnessが消す範囲
+			//Range resetBrightness clears when per-tile updates are turned off.
+			buildReachRegion(fineLayer(), m_lightSources, m_litRegion, m_lightSources.size());
+		}
+
+		//1ステップで光が進むセル数。その場で更新すると1ステップの4パスの間に3セルまで進む
+		//Cells light advances per step. Updating in place, it advances up to 3 cells over the 4 passes of a step.
+		int propagationSpeed()const
+		{
+			return m_redBlack ? 3 : 1;
+		}
+
+		static bool isSameSource(const LightSource& a, const LightSource& b)
+		{
+			return a.cell == b.cell && a.range == b.range
+				&& a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b;
+		}
+
+		void markDirtyTiles(const Point& center, int radius)
+		{
+			markDirtyTiles(Rect(center.x - radius, center.y - radius, 2 * radius + 1, 2 * radius + 1));
+		}
+
+		void markDirtyTiles(const Rect& cells)
+		{
+			const int tileSize = Max(m_tileSchedule.tileSize, 1);
+			const int beginX = Max(cells.x, 0) / tileSize;
+			const int beginY = Max(cells.y, 0) / tileSize;
+			const int endX = Min((cells.x + cells.w + tileSize - 1) / tileSize, static_cast<int>(m_tileDirty.width()));
+			const int endY = Min((cells.y + cells.h + tileSize - 1) / tileSize, static_cast<int>(m_tileDirty.height()));
+
+			for (int ty = beginY; ty < endY; ++ty)
+			{
+				for (int tx = beginX; tx < endX; ++tx)
+				{
+					m_tileDirty[ty][tx] = static_cast<char>(true);
+				}
+			}
+		}
+
+		//粗い格子で壁になったセルの中にあるライトは、そのまま注入すると壁の反対側へ漏れる
+		//細かい格子で壁に遮られずに届く隣の粗いセルにだけ、そこまでの距離で減衰させて注入する
+		//A light inside a cell that became a wall on a coarse grid would leak to the other side if injected as is.
+		//Inject only into neighboring coarse cells reachable on the fine grid without crossing walls, attenuated by the distance.
+		void injectAroundCoarseWall(const LightLayer& layer, const LightSource& source, const Point& coarseCell)
+		{
+			const Point origin = source.cell;
+			if (!m_isWall.isValid(origin))
+			{
+				return;
+			}
+
+			if (!isWall(origin))
+			{
+				injectAroundCoarseWall(layer, origin, source.color, coarseCell);
+				return;
+			}
+
+			//細かい格子でも壁の中にあるライトは隣の壁でないセルを照らすので、そのセルから注入する
+			//A light inside a wall on the fine grid as well lights its neighbouring non-wall cells, so inject from those cells.
+			for (const auto& direction : neighborDirections())
+			{
+				const Point neighbor = origin + direction;
+				if (!m_isWall.isValid(neighbor) || isWall(neighbor) || isDiagonalBlocked(m_isWall, neighbor, -direction))
+				{
+					continue;
+				}
+
+				const Point coarseNeighbor(neighbor.x / layer.scale, neighbor.y / layer.scale);
+				const ColorF color = source.color * attenuation(direction);
+				if (layer.isWall[coarseNeighbor] != FieldWall())
+				{
+					raise(layer.brightness.current()[coarseNeighbor], color);
+				}
+				else
+				{
+					injectAroundCoarseWall(layer, neighbor, color, coarseNeighbor);
+				}
+			}
+		}
+
+		void injectAroundCoarseWall(const LightLayer& layer, const Point& origin, const ColorF& color, const Point& coarseCell)
+		{
+			const int s = layer.scale;
+			auto& brightness = layer.brightness.current();
+			for (const auto& direction : neighborDirections())
+			{
+				const Point neighbor = coarseCell + direction;
+				if (!brightness.isValid(neighbor) || layer.isWall[neighbor] == FieldWall())
+				{
+					continue;
+				}
+
+				const Point target(Clamp(origin.x, neighbor.x*s, neighbor.x*s + s - 1), Clamp(origin.y, neighbor.y*s, neighbor.y*s + s - 1));
+				if (!m_isWall.isValid(target) || !hasLineOfSight(origin, target))
+				{
+					continue;
+				}
+
+				const int dx = Abs(target.x - origin.x);
+				const int dy = Abs(target.y - origin.y);
+				const double distance = Max(dx, dy) - Min(dx, dy) + Min(dx, dy)*Sqrt(2.0);
+				raise(brightness[neighbor], color * pow(attenuation(Point(1, 0)), distance));
+			}
+		}
+
+		//隣のセルへ光が進むときの減衰率。scaleは1セルが何セル分の大きさか
+		//Attenuation of light advancing to a neighbor cell. scale is how many fine cells one cell spans.
+		static double attenuation(const Point& direction, int scale = 1)
+		{
+			const double attenuationAdjacent = 0.9;
+			static const double attenuationDiagonal = pow(attenuationAdjacent, Sqrt(2.0));
+			const bool diagonal = direction.x != 0 && direction.y != 0;
+			if (scale == 1)
+			{
+				return diagonal ? attenuationDiagonal : attenuationAdjacent;
+			}
+			return pow(attenuationAdjacent, (diagonal ? Sqrt(2.0) : 1.0)*scale);
+		}
+
+		//縦横どちらかがつながっていないと斜め方向に光は届かない
+		//Light isn't propagate diagonally in case that blocks are put length and width.
+		static bool isDiagonalBlocked(const Grid2D<char>& walls, const Point& p, const Point& direction)
+		{
+			return direction.x != 0 && direction.y != 0
+				&& walls[p.y][p.x + direction.x] == FieldWall()
+				&& walls[p.y + direction.y][p.x] == FieldWall();
+		}
+
+		bool isDiagonalBlocked(const Point& p, const Point& direction)const
+		{
+			return isDiagonalBlocked(m_isWall, p, direction);
+		}
+
+		static const std::array<Point, 8>& neighborDirections()
+		{
+			static const std::array<Point, 8> directions =
+			{
+				Point(-1,-1),Point(+0,-1),Point(+1,-1),
+				Point(-1,+0),             Point(+1,+0),
+				Point(-1,+1),Point(+0,+1),Point(+1,+1)
+			};
+			return directions;
+		}
+
+		enum RepairFlag : char
+		{
+			RepairCleared = 1,
+			RepairQueued = 2,
+		};
+
+		//前のフレームの明るさを、光源と壁の変化に合わせて局所的に修復する
+		//動的最短路の修復と同じく、消えた光源に依存していたセルを消してから周囲から育て直す
+		//結果は届く範囲の和集合の中での不動点で、掃引で一から計算したものと同じになる
+		//Locally repair the previous brightness according to changes of sources and walls.
+		//Like dynamic shortest path repair, cells depending on vanished sources are cleared, then regrown from around.
+		//The result is the fixpoint within the union of reach, the same as computing it from scratch by sweeps.
+		void repairLight()
+		{
+			auto& brightness = m_brightness.current();
+			const size_t width = m_isWall.width();
+			const size_t height = m_isWall.height();
+
+			updateInterestRegion(maxLightReach());
+			if (!m_warmValid)
+			{
+				Fill(cellPolicy(), brightness, ColorF(Palette::Black));
+				m_reachCoverage.resize(width, height);
+				Fill(cellPolicy(), m_reachCoverage, uint32(0));
+				m_repairFlag.resize(width, height);
+				Fill(cellPolicy(), m_repairFlag, char(0));
+				std::fill(m_lightSourceRange.begin(), m_lightSourceRange.end(), -1.0);
+				m_retiredSources.clear();
+				m_pendingWallRects.clear();
+				m_wallSourceCells.clear();
+				m_wallSourceValues.clear();
+				m_warmValid = true;
+			}
+
+			//壁の中の光源のセルに、前のフレームの終わりに消した値を戻す。そこから導かれたセルを消すときに使う
+			//Restore the values cleared at the end of the previous frame in cells of sources inside walls. They are used when clearing cells derived from them.
+			for (size_t k = 0; k < m_wallSourceCells.size(); ++k)
+			{
+				brightness[m_wallSourceCells[k]] = m_wallSourceValues[k];
+			}
+			m_wallSourceCells.clear();
+			m_wallSourceValues.clear();
+
+			//消えた光源と、動いたり変化したりした光源の古い状態を取り除く
+			//Remove vanished sources and old states of moved or changed sources.
+			for (const auto& source : m_retiredSources)
+			{
+				retireSource(source.cell, source.range);
+			}
+			m_retiredSources.clear();
+
+			for (size_t i = 0; i < m_frameSources.size(); ++i)
+			{
+				const Point cell = m_frameSources[i].cell;
+				const ColorF color = m_frameSources[i].color;
+				const double range = Max(m_frameSources[i].range, 0.0);
+
+				if (0.0 <= m_lightSourceRange[i])
+				{
+					const ColorF& previous = m_lightSourceColor[i];
+					if (cell == m_lightSourceCell[i] && range == m_lightSourceRange[i]
+						&& color.r == previous.r && color.g == previous.g && color.b == previous.b)
+					{
+						continue;
+					}
+					retireSource(m_lightSourceCell[i], m_lightSourceRange[i]);
+				}
+
+				coverDisc(cell, range);
+				m_lightSourceCell[i] = cell;
+				m_lightSourceColor[i] = color;
+				m_lightSourceRange[i] = range;
+			}
+
+			//壁が変わったセルの4近傍では、そのセルを挟む斜めの遮りが変わる。1セル広げた範囲を消して、連鎖と取り込みに任せる
+			//Diagonal blocking across a changed cell changes for its 4 neighbors. Clear the area expanded by one cell and leave the rest to the cascade and pulls.
+			for (const auto& rect : m_pendingWallRects)
+			{
+				const int beginY = Max(rect.y - 1, 0);
+				const int endY = Min(rect.y + rect.h + 1, static_cast<int>(height));
+				const int beginX = Max(rect.x - 1, 0);
+				const int endX = Min(rect.x + rect.w + 1, static_cast<int>(width));
+				for (int y = beginY; y < endY; ++y)
+				{
+					for (int x = beginX; x < endX; ++x)
+					{
+						clearCell(brightness, Point(x, y));
+					}
+				}
+			}
+			m_pendingWallRects.clear();
+
+			//消したセルの値から導かれていた隣のセルを連鎖的に消す
+			//Clear neighbor cells derived from cleared values in cascade.
+			for (size_t k = 0; k < m_clearedCells.size(); ++k)
+			{
+				const Point p = m_clearedCells[k];
+				const ColorF old = m_clearedValues[k];
+				for (const auto& direction : neighborDirections())
+				{
+					const Point neighbor = p + direction;
+					if (!brightness.isValid(neighbor) || (m_repairFlag[neighbor] & RepairCleared))
+					{
+						continue;
+					}
+
+					const double a = attenuation(direction)*(1.0 + 1e-9);
+					const ColorF& value = brightness[neighbor];
+					if ((0.0 < value.r && value.r <= old.r*a)
+						|| (0.0 < value.g && value.g <= old.g*a)
+						|| (0.0 < value.b && value.b <= old.b*a))
+					{
+						clearCell(brightness, neighbor);
+					}
+				}
+			}
+
+			//光源を注入し直し、消したセルと新しく光が届くようになったセルは周囲から値を取り込む
+			//Re-inject sources, and cleared cells and newly reachable cells take values from around.
+			for (size_t i = 0; i < m_frameSources.size(); ++i)
+			{
+				const Point cell = m_lightSourceCell[i];
+				if (brightness.isValid(cell) && 0 < m_reachCoverage[cell] && raise(brightness[cell], m_lightSourceColor[i]))
+				{
+					enqueueRelax(cell);
+				}
+			}
+
+			for (const auto& p : m_clearedCells)
+			{
+				pullFromNeighbors(brightness, p);
+			}
+			for (const auto& p : m_pullCells)
+			{
+				pullFromNeighbors(brightness, p);
+			}
+
+			for (size_t k = 0; k < m_relaxQueue.size(); ++k)
+			{
+				const Point p = m_relaxQueue[k];
+				m_repairFlag[p] &= ~RepairQueued;
+
+				const ColorF value = brightness[p];
+				for (const auto& direction : neighborDirections())
+				{
+					const Point neighbor = p + direction;
+					if (!brightness.isValid(neighbor) || isWall(neighbor) || m_reachCoverage[neighbor] == 0 || isDiagonalBlocked(p, direction))
+					{
+						continue;
+					}
+
+					if (raise(brightness[neighbor], value*attenuation(direction)))
+					{
+						enqueueRelax(neighbor);
+					}
+				}
+			}
+
+			for (const auto& p : m_clearedCells)
+			{
+				m_repairFlag[p] = 0;
+			}
+			m_clearedCells.clear();
+			m_clearedValues.clear();
+			m_pullCells.clear();
+			m_relaxQueue.clear();
+
+			//壁の中の光源は、ステップで伝播させるときと同じく周囲に広げた後で消す
+			//Sources inside walls are cleared after spreading to their neighbors, as with stepped propagation.
+			for (size_t i = 0; i < m_frameSources.size(); ++i)
+			{
+				const Point cell = m_lightSourceCell[i];
+				if (!brightness.isValid(cell) || !isWall(cell))
+				{
+					continue;
+				}
+
+				const ColorF& value = brightness[cell];
+				if (0.0 < value.r || 0.0 < value.g || 0.0 < value.b)
+				{
+					m_wallSourceCells.push_back(cell);
+					m_wallSourceValues.push_back(brightness[cell]);
+					brightness[cell] = Palette::Black;
+				}
+			}
+		}
+
+		//各チャンネルをより明るい方に更新し、変化したかを返す
+		//Update each channel to the brighter one and return whether anything changed.
+		static bool raise(ColorF& cell, const ColorF& candidate)
+		{
+			bool raised = false;
+			if (cell.r < candidate.r)
+			{
+				cell.r = candidate.r;
+				raised = true;
+			}
+			if (cell.g < candidate.g)
+			{
+				cell.g = candidate.g;
+				raised = true;
+			}
+			if (cell.b < candidate.b)
+			{
+				cell.b = candidate.b;
+				raised = true;
+			}
+			return raised;
+		}
+
+		void clearCell(Grid2D<ColorF>& brightness, const Point& p)
+		{
+			if (!brightness.isValid(p) || (m_repairFlag[p] & RepairCleared))
+			{
+				return;
+			}
+
+			m_repairFlag[p] |= RepairCleared;
+			m_clearedCells.push_back(p);
+			m_clearedValues.push_back(brightness[p]);
+			brightness[p] = Palette::Black;
+		}
+
+		void enqueueRelax(const Point& p)
+		{
+			if (!(m_repairFlag[p] & RepairQueued))
+			{
+				m_repairFlag[p] |= RepairQueued;
+				m_relaxQueue.push_back(p);
+			}
+		}
+
+		void pullFromNeighbors(Grid2D<ColorF>& brightness, const Point& p)
+		{
+			if (!brightness.isValid(p) || isWall(p) || m_reachCoverage[p] == 0)
+			{
+				return;
+			}
+
+			bool raised = false;
+			for (const auto& direction : neighborDirections())
+			{
+				const Point neighbor = p + direction;
+				if (brightness.isValid(neighbor) && !isDiagonalBlocked(p, direction))
+				{
+					raised |= raise(brightness[p], brightness[neighbor] * attenuation(direction));
+				}
+			}
+
+			if (raised)
+			{
+				enqueueRelax(p);
+			}
+		}
+
+		void coverDisc(const Point& center, double range)
+		{
+			forEachDiscCell(center, range, [this](const Point& p)
+			{
+				if (m_reachCoverage[p]++ == 0)
+				{
+					m_pullCells.push_back(p);
+				}
+			});
+		}
+
+		//光源が注入していたセルと、どの光源も届かなくなったセルを消す
+		//Clear the cell the source injected into and cells no source reaches anymore.
+		void retireSource(const Point& cell, double range)
+		{
+			auto& brightness = m_brightness.current();
+			clearCell(brightness, cell);
+			forEachDiscCell(cell, range, [this, &brightness](const Point& p)
+			{
+				if (--m_reachCoverage[p] == 0)
+				{
+					clearCell(brightness, p);
+				}
+			});
+		}
+
+		template<class Func>
+		void forEachDiscCell(const Point& center, double radius, Func func)const
+		{
+			const int r = static_cast<int>(Ceil(radius));
+			for (int dy = -r; dy <= r; ++dy)
+			{
+				const int y = center.y + dy;
+				const double half = radius*radius - dy*dy;
+				if (half < 0.0 || y < 0 || static_cast<int>(m_isWall.height()) <= y)
+				{
+					continue;
+				}
+
+				//注目領域と重なる部分だけを列挙する
+				//Enumerate only the part overlapping the regions of interest.
+				const int halfWidth = static_cast<int>(Sqrt(half));
+				for (const auto& span : m_interestRegion.row(y))
+				{
+					const int beginX = Max(center.x - halfWidth, span.begin);
+					const int endX = Min(center.x + halfWidth + 1, span.end);
+					for (int x = beginX; x < endX; ++x)
+					{
+						func(Point(x, y));
+					}
+				}
+			}
+		}
+
+		Point mouseGridPos(const InputSource& input)const
+		{
+			const auto p = input.cursorPos().asPoint();
+			return Point(p.x / gridUnitPixel(), p.y / gridUnitPixel());
+		}
+
+		Point gridPos(const Point& p)const
+		{
+			return Point(Floor(1.0*p.x / gridUnitPixel()), Floor(1.0*p.y / gridUnitPixel()));
+		}
+
+		//ライト同士の反発と衝突
+		//各ライトは自分の速度と位置の変化量だけを書くので、ライト単位で並列に処理できる
+		//Repulsion and collision between lights.
+		//Each light writes only its own velocity and position deltas, so lights are processed in parallel.
+		void interactLights(double dt)
+		{
+			const size_t count = m_lightPos.size();
+
+			//接触判定が近傍セルに収まるように、セルの大きさはライトの直径以上にする
+			//Keep the cell size at least the light diameter so that contacts stay within neighbor cells.
+			const double radius = Max(m_lightInteraction.radius, static_cast<double>(gridUnitPixel()));
+			m_lightHash.build(m_lightPos, radius, executor());
+
+			m_velocityDelta.assign(count, Vec2(0, 0));
+			m_positionDelta.assign(count, Vec2(0, 0));
+
+			executor().parallelFor(count, [&](size_t i)
+			{
+				const Vec2 pos = m_lightPos[i].center;
+				Vec2 velocityDelta(0, 0);
+				Vec2 positionDelta(0, 0);
+
+				m_lightHash.forEachNeighbor(pos, [&](uint32 j)
+				{
+					if (j == i)
+					{
+						return;
+					}
+
+					const Vec2 offset = pos - m_lightPos[j].center;
+					const double distanceSq = offset.lengthSq();
+					if (radius*radius <= distanceSq)
+					{
+						return;
+					}
+
+					const double distance = Sqrt(distanceSq);
+
+					//完全に重なっているときは添字で方向を決めて対称に押し出す
+					//When fully overlapped, decide the direction by index so that both are pushed symmetrically.
+					const Vec2 normal = 0.0 < distance ? offset / distance : Vec2(i < j ? -1.0 : 1.0, 0.0);
+
+					velocityDelta += normal*(m_lightInteraction.repulsion*(1.0 - distance / radius)*dt);
+
+					const double contact = m_lightPos[i].r + m_lightPos[j].r;
+					if (distance < contact)
+					{
+						positionDelta += normal*((contact - distance)*0.5);
+
+						const double approaching = (m_velocity[i] - m_velocity[j]).dot(normal);
+						if (approaching < 0.0)
+						{
+							velocityDelta -= normal*(approaching*(1.0 + m_lightInteraction.restitution)*0.5);
+						}
+					}
+				});
+
+				m_velocityDelta[i] = velocityDelta;
+				m_positionDelta[i] = positionDelta;
+			});
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				m_velocity[i] += m_velocityDelta[i];
+				m_lightPos[i].center += m_positionDelta[i];
+			}
+		}
+
+		//pass番目のパスでy行目のうち更新するセルのxの偶奇。-1ならすべて、-2なら更新しない
+		//Parity of x of cells in row y updated in the given pass. -1 means all, -2 means none.
+		static int colourParity(size_t pass, size_t numPasses, size_t y)
+		{
+			if (numPasses == 1)
+			{
+				return -1;
+			}
+
+			return (pass / 2 == y % 2) ? static_cast<int>(pass % 2) : -2;
+		}
+
+		//細かい格子をタイル単位で1ステップ進める。壁だけのタイルと、周りのタイルが前のステップで変わらなかったタイルは結果が変わらないので飛ばす
+		//前のステップの値が書き込み側のバッファにも残っているので、飛ばしたタイルは写す必要もない。最初のステップではすべて計算する
+		//どれかのタイルが変わったかを返す
+		//Advance the fine grid by one step tile by tile. Solid tiles, and tiles whose surrounding tiles did not change in the previous step, keep their result and are skipped.
+		//The previous values also remain in the write side buffer, so skipped tiles need no copy. The first step computes everything.
+		//Returns whether any tile changed.
+		bool stepTiles(const LightLayer& layer, bool firstStep)
+		{
+			const size_t minTileRows = Max<size_t>(4096 / Max<size_t>(layer.isWall.width()*TileSize, 1u), 1u);
+			executor().parallelFor(m_tileClasses.height(), [this, &layer, firstStep](size_t tileY)
+			{
+				stepTileRow(layer, static_cast<int>(tileY), firstStep);
+			}, minTileRows);
+
+			std::swap(m_tileStepChanged, m_tileStepChangedNext);
+			return Reduce(execution::seq, m_tileStepChanged, false, [](bool changed, char tileChanged) { return changed || tileChanged != 0; });
+		}
+
+		//1行分のタイルを進める。計算するタイルが並んでいればまとめて1つの区間として処理し、開けたタイルの並びには壁と境界を調べない計算を使う
+		//Advance a row of tiles. Consecutive tiles to compute are processed as one range, and ranges of open tiles use the kernel without wall and bounds checks.
+		void stepTileRow(const LightLayer& layer, int tileY, bool firstStep)
+		{
+			const auto& read = layer.brightness.read();
+			auto& write = layer.brightness.write();
+			const int tilesX = static_cast<int>(m_tileClasses.width());
+			const int width = static_cast<int>(read.width());
+			const int beginY = tileY*TileSize;
+			const int endY = Min(beginY + TileSize, static_cast<int>(read.height()));
+			auto changed = m_tileStepChangedNext[tileY];
+
+			int tileX = 0;
+			while (tileX < tilesX)
+			{
+				changed[tileX] = 0;
+				if (!needsTileStep({ tileX, tileY }, firstStep))
+				{
+					++tileX;
+					continue;
+				}
+
+				const bool open = m_tileClasses[tileY][tileX] == TileClass::Open;
+				int endTileX = tileX + 1;
+				while (endTileX < tilesX && (m_tileClasses[tileY][endTileX] == TileClass::Open) == open && needsTileStep({ endTileX, tileY }, firstStep))
+				{
+					changed[endTileX] = 0;
+					++endTileX;
+				}
+
+				const int beginX = tileX*TileSize;
+				const int endX = Min(endTileX*TileSize, width);
+				for (int y = beginY; y < endY; ++y)
+				{
+					if (!open)
+					{
+						stepLightDiffusion(layer, layer.activeRegion, y, -1, beginX, endX);
+					}
+
+					layer.activeRegion.forEachSpanIn(y, beginX, endX, [&](int begin, int end)
+					{
+						if (open)
+						{
+							diffuseOpenCells(read[y - 1].data(), read[y].data(), read[y + 1].data(), write[y].data(), begin, end, 1, attenuation(Point(1, 0)), attenuation(Point(1, 1)));
+						}
+
+						//値は増えるか変わらないかなので、ビット列を比べれば変化がわかる
+						//Values only rise or stay, so comparing bit patterns detects changes.
+						for (int tileBegin = begin; tileBegin < end; tileBegin = (tileBegin / TileSize + 1)*TileSize)
+						{
+							const int tileEnd = Min((tileBegin / TileSize + 1)*TileSize, end);
+							if (!changed[tileBegin / TileSize] && std::memcmp(&read[y][tileBegin], &write[y][tileBegin], (tileEnd - tileBegin)*sizeof(ColorF)) != 0)
+							{
+								changed[tileBegin / TileSize] = 1;
+							}
+						}
+					});
+				}
+
+				tileX = endTileX;
+			}
+		}
+
+		//壁だけのタイルはそれ自身が、それ以外のタイルは周りの3x3のタイルのどれかが前のステップで変わったときだけ計算する
+		//A solid tile is computed only if it changed itself in the previous step, and other tiles only if any of the surrounding 3x3 tiles did.
+		bool needsTileStep(const Point& tile, bool firstStep)const
+		{
+			if (firstStep)
+			{
+				return true;
+			}
+
+			return m_tileClasses[tile] == TileClass::Solid ? m_tileStepChanged[tile] != 0 : isTileNeighborhoodChanged(tile);
+		}
+
+		bool isTileNeighborhoodChanged(const Point& tile)const
+		{
+			for (int y = Max(tile.y - 1, 0); y <= Min(tile.y + 1, static_cast<int>(m_tileStepChanged.height()) - 1); ++y)
+			{
+				for (int x = Max(tile.x - 1, 0); x <= Min(tile.x + 1, static_cast<int>(m_tileStepChanged.width()) - 1); ++x)
+				{
+					if (m_tileStepChanged[y][x])
+					{
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		//regionのy行目のうちxの偶奇がparityのセルを1ステップ進め、更新したセルの数を返す。全行を進めたら呼び出し側でflipする
+		//壁のない区間の内側では左右が壁でないので斜めの遮りも起こらず、分岐なしで8近傍を読める。境界や遮りを調べるのは区間の端だけ
+		//[clipBegin, clipEnd) で列を限る（タイル単位の更新用）
+		//Advance cells in row y of region whose x parity is parity by one step, and return the number of updated cells. The caller flips after all rows.
+		//Inside a wall-free span neither side is a wall, so no diagonal is blocked and the 8 neighbors are read without branches. Bounds and blocking are checked only at span ends.
+		//[clipBegin, clipEnd) limits the columns (for per-tile updates).
+		static size_t stepLightDiffusion(const LightLayer& layer, const CellRegion& region, size_t y, int parity,
+			int clipBegin = 0, int clipEnd = std::numeric_limits<int>::max())
+		{
+			if (parity == -2)
+			{
+				return 0;
+			}
+
+			const int stride = parity < 0 ? 1 : 2;
+
+			const auto& neighbors = neighborDirections();
+
+			std::array<double, 8> attenuations;
+			for (size_t i = 0; i < neighbors.size(); ++i)
+			{
+				attenuations[i] = attenuation(neighbors[i], layer.scale);
+			}
+
+			const auto& read = layer.brightness.read();
+			auto& write = layer.brightness.write();
+			const bool hasRowsAround = 0 < y && y + 1 < read.height();
+			const auto& openRuns = layer.openSpans.row(y);
+
+			size_t numUpdated = 0;
+			size_t j = std::lower_bound(openRuns.begin(), openRuns.end(), clipBegin, [](const CellRegion::Span& run, int x) { return run.end <= x; }) - openRuns.begin();
+			region.forEachSpanIn(y, clipBegin, clipEnd, [&](int spanBegin, int spanEnd)
+			{
+				int x = parity < 0 || (spanBegin & 1) == parity ? spanBegin : spanBegin + 1;
+				numUpdated += (Max(spanEnd - x, 0) + stride - 1) / stride;
+
+				while (x < spanEnd)
+				{
+					while (j < openRuns.size() && openRuns[j].end <= x)
+					{
+						++j;
+					}
+					const int runBegin = j < openRuns.size() ? openRuns[j].begin : spanEnd;
+					const int runEnd = j < openRuns.size() ? openRuns[j].end : spanEnd;
+
+					for (; x < Min(runBegin, spanEnd); x += stride)
+					{
+						write[y][x] = Palette::Black;
+					}
+
+					const int end = Min(runEnd, spanEnd);
+					const int fastBegin = hasRowsAround ? runBegin + 1 : end;
+					const int fastEnd = hasRowsAround ? runEnd - 1 : end;
+
+					for (; x < end && x < fastBegin; x += stride)
+					{
+						diffuseCell(layer, attenuations, x, y);
+					}
+					if (x < Min(fastEnd, end))
+					{
+						diffuseOpenCells(read[y - 1].data(), read[y].data(), read[y + 1].data(), write[y].data(), x, Min(fastEnd, end), stride, attenuations[1], attenuations[0]);
+						x += (Min(fastEnd, end) - x + stride - 1) / stride*stride;
+					}
+					for (; x < end; x += stride)
+					{
+						diffuseCell(layer, attenuations, x, y);
+					}
+				}
+			});
+
+			return numUpdated;
+		}
+
+		//壁でないセルをひとつ、近傍の境界と斜めの遮りを調べながら更新する
+		//Update a single non-wall cell, checking bounds and diagonal blocking of neighbors.
+		static void diffuseCell(const LightLayer& layer, const std::array<double, 8>& attenuations, int x, int y)
+		{
+			const auto& neighbors = neighborDirections();
+			const auto& read = layer.brightness.read();
+			auto& write = layer.brightness.write();
+
+			ColorF maxBrightness = Palette::Black;
+			for (size_t i = 0; i < neighbors.size(); ++i)
+			{
+				const auto& side = neighbors[i];
+				const Point sideCell = Point(x, y) + side;
+				if (!read.isValid(sideCell) || isDiagonalBlocked(layer.isWall, { x, y }, side))
+				{
+					continue;
+				}
+
+				const double a = attenuations[i];
+				maxBrightness.r = Max(maxBrightness.r, read[sideCell].r*a);
+				maxBrightness.g = Max(maxBrightness.g, read[sideCell].g*a);
+				maxBrightness.b = Max(maxBrightness.b, read[sideCell].b*a);
+			}
+
+			write[y][x].r = Max(read[y][x].r, maxBrightness.r);
+			write[y][x].g = Max(read[y][x].g, maxBrightness.g);
+			write[y][x].b = Max(read[y][x].b, maxBrightness.b);
+		}
+
+		//壁のない区間の内側 [begin, end) を、上下と同じ行の値から分岐なしで更新する
+		//Update the inside [begin, end) of a wall-free span from the rows above, below and itself without branches.
+		static void diffuseOpenCells(const ColorF* above, const ColorF* center, const ColorF* below, ColorF* out,
+			int begin, int end, int stride, double adjacent, double diagonal)
+		{
+			for (int x = begin; x < end; x += stride)
+			{
+				double r = center[x].r;
+				double g = center[x].g;
+				double b = center[x].b;
+
+				const ColorF* adjacentCells[4] = { &above[x], &center[x - 1], &center[x + 1], &below[x] };
+				for (const ColorF* side : adjacentCells)
+				{
+					r = Max(r, side->r*adjacent);
+					g = Max(g, side->g*adjacent);
+					b = Max(b, side->b*adjacent);
+				}
+
+				const ColorF* diagonalCells[4] = { &above[x - 1], &above[x + 1], &below[x - 1], &below[x + 1] };
+				for (const ColorF* side : diagonalCells)
+				{
+					r = Max(r, side->r*diagonal);
+					g = Max(g, side->g*diagonal);
+					b = Max(b, side->b*diagonal);
+				}
+
+				out[x].r = r;
+				out[x].g = g;
+				out[x].b = b;
+			}
+		}
+
+		Size m_fieldSize;
+		Grid2D<char> m_isWall;
+		BitGrid2D m_wallMask;
+		Grid2D<TileClass> m_tileClasses;
+		bool m_tileClassification = false;
+
+		//タイルごとに、直前のステップで値が変わったセルがあったか
+		//Per tile, whether any cell changed in the previous step.
+		Grid2D<char> m_tileStepChanged;
+		Grid2D<char> m_tileStepChangedNext;
+		CellRegion m_openSpans;
+		uint64 m_wallRevision = 0;
+		DoubleBuffer<Grid2D<ColorF>> m_brightness;
+
+		//composeLightmapで重ねる動かない光と、その途中と結果の格子
+		//Static light overlaid by composeLightmap, and its intermediate and result grids.
+		Grid2D<ColorF> m_staticLightmap;
+		Grid2D<ColorF> m_upsampledBrightness;
+		Grid2D<ColorF> m_lightmap;
+		bool m_redBlack = false;
+		bool m_sweep = false;
+		bool m_vector = false;
+		std::vector<VectorLightBuffer> m_vectorBuffers;
+
+		//掃引で、帯ごとに直前の往復で値が変わったか
+		//For sweeps, whether each band changed in the last round trip.
+		std::vector<char> m_sweepBandChanged;
+
+		//壁までの符号付き距離。ライトの衝突判定と模様を書き込めるかの判定に使い、壁を書き換えたときは周りだけを計算し直す
+		//Signed distance to walls. Used for light collision and for deciding whether a light can be stamped, recomputed only around edited walls.
+		SignedWallDistance m_wallDistance;
+
+		//届く範囲に壁がないライトを模様で書き込むための、届く距離ごとの模様
+		//Patterns per reach for writing lights with no walls within reach as stamps.
+		bool m_stamps = false;
+		LightStamp m_lightStamp = LightStamp(attenuation(Point(1, 0)), attenuation(Point(1, 1)));
+		std::vector<LightSource> m_stampedSources;
+
+		//ほかのライトの範囲に接するかを調べるための、ライトの範囲の円と空間ハッシュ
+		//Discs of light reach and their spatial hash, for testing whether a light touches another light's reach.
+		std::vector<Circle> m_stampCircles;
+		SpatialHash m_stampHash;
+		std::vector<LightSource> m_propagatedSources;
+
+		//ライトの光を届く部屋に限るための部屋と入口のグラフ
+		//Graph of rooms and portals for limiting each light to the rooms it reaches.
+		bool m_portalConfinement = false;
+		PortalGraph m_portals;
+
+		//ライトの動きに使う乱数。フィールドごとに持つので、どのスレッドで動かしても同じ結果になる
+		//Random numbers for moving lights. Held per field, so the result is the same on whichever thread it runs.
+		std::mt19937 m_random = std::mt19937(RandomEngine()());
+		std::vector<Circle> m_lightPos;
+		std::vector<ColorF> m_lightColor;
+		std::vector<Vec2> m_velocity;
+		std::vector<double> m_lightIntensity;
+		std::vector<double> m_lightRange;
+
+		//届く距離の長い順に並べたライトの添字と、光の計算で更新する領域
+		//Light indices sorted by reach in descending order, and regions updated by light computation.
+		std::vector<LightSource> m_lightSources;
+
+		//collectLightSourcesで写し取った光源（ライトの添字順）と描画するライト
+		//Sources copied by collectLightSources (in light index order) and lights to draw.
+		std::vector<LightSource> m_frameSources;
+		std::vector<Circle> m_drawnLightPos;
+		std::vector<ColorF> m_drawnLightColor;
+		std::vector<Rect> m_regionsOfInterest;
+		CellRegion m_interestRegion;
+		int m_interestMargin = -1;
+
+		//壁でないセルの部屋分けと、注目領域のうち光源のある部屋の部分
+		//m_builtLitRoomsはm_roomInterestRegionを作ったときの光源のある部屋（負の値は壁の中のライトのセル）
+		//Split of non-wall cells into rooms, and the part of the regions of interest in rooms holding sources.
+		//m_builtLitRooms are the rooms holding sources when m_roomInterestRegion was built (negative values are cells of lights inside walls).
+		RoomLabels m_rooms;
+		std::vector<int> m_litRooms;
+		std::vector<int> m_builtLitRooms;
+		CellRegion m_roomInterestRegion;
+		bool m_roomRegionValid = false;
+		CellRegion m_litRegion;
+		CellRegion m_activeRegion;
+		CellRegion m_nextRegion;
+
+		LightingLod m_lod;
+		std::vector<LodLevel> m_lodLevels;
+
+		//タイル単位の更新の状態
+		//前のフレームに反映した光源と、計算し直すタイルの印を覚えておく
+		//State of per-tile updates.
+		//Remembers the sources applied in the previous frame and marks of tiles to recompute.
+		TileSchedule m_tileSchedule;
+		bool m_tilesValid = false;
+		int m_tileMargin = 0;
+		size_t m_tileFrame = 0;
+		size_t m_numUpdatedTiles = 0;
+		Grid2D<char> m_tileDirty;
+		std::vector<LightSource> m_tileSources;
+		std::vector<LightSource> m_tileSourcesNext;
+		std::vector<Rect> m_tileWallRects;
+		std::vector<ColorF> m_tileHalo;
+		CellRegion m_tileRegion;
+		CellRegion m_tileInterestRegion;
+		CellRegion m_tileLitRegion;
+		CellRegion m_tileActiveRegion;
+		CellRegion m_tileNextRegion;
+
+		//複数フレームに分けた光の計算の状態
+		//計算を始めたときの光源と注目領域を使い、表示中の明るさとは別のバッファに書く
+		//State of light computation spread over frames.
+		//Uses the sources and regions of interest at its start, and writes to buffers separate from the displayed brightness.
+		size_t m_propagationBudget = 0;
+		bool m_slicing = false;
+		PropagationState m_slicedState;
+		std::vector<LightSource> m_slicedSources;
+		DoubleBuffer<Grid2D<ColorF>> m_slicedBrightness;
+		CellRegion m_slicedInterestRegion;
+		CellRegion m_slicedLitRegion;
+		CellRegion m_slicedActiveRegion;
+		CellRegion m_slicedNextRegion;
+
+		//ウォームスタートの状態
+		//光源ごとに最後に反映した位置・色・到達距離と、各セルに届く光源の数を覚えておく
+		//State of warm start.
+		//Remembers the last applied cell, colour and reach of each source, and how many sources reach each cell.
+		struct RetiredSource
+		{
+			Point cell;
+			double range;
+		};
+
+		bool m_warmStart = false;
+		bool m_warmValid = false;
+		std::vector<Point> m_lightSourceCell;
+		std::vector<ColorF> m_lightSourceColor;
+		std::vector<double> m_lightSourceRange;
+		std::vector<RetiredSource> m_retiredSources;
+		std::vector<Rect> m_pendingWallRects;
+		Grid2D<uint32> m_reachCoverage;
+		Grid2D<char> m_repairFlag;
+		std::vector<Point> m_clearedCells;
+		std::vector<ColorF> m_clearedValues;
+		std::vector<Point> m_pullCells;
+		std::vector<Point> m_relaxQueue;
+		std::vector<Point> m_wallSourceCells;
+		std::vector<ColorF> m_wallSourceValues;
+
+		//密な配列の添字とハンドルのスロットの対応
+		//Mapping between dense array indices and handle slots.
+		std::vector<uint32> m_lightSlot;
+		std::vector<uint32> m_slotIndex;
+		std::vector<uint32> m_slotGeneration;
+		std::vector<uint32> m_freeSlots;
+
+		LightInteraction m_lightInteraction;
+		SpatialHash m_lightHash;
+
+		//nullptrのときはDefaultExecutorを使う。使うまでプールのスレッドは作られない
+		//DefaultExecutor is used when nullptr. Its pool threads are not created until used.
+		Executor* m_executor = nullptr;
+		std::vector<Vec2> m_velocityDelta;
+		std::vector<Vec2> m_positionDelta;
+	};
+}
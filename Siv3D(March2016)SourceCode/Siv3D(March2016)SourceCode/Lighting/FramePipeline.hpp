@@ -0,0 +1,158 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <array>
+#include <functional>
+#include "Field.hpp"
+#include "TaskGraph.hpp"
+
+namespace lighting
+{
+	//フィールドの1フレームを 入力 → 物理 → 注入 → 拡散 → 合成 → 出力 のタスクに分けてTaskGraphで実行する
+	//フレームNの合成と出力は、フレームN+1の入力と物理と並んで進む。同時に進むフレームは最大NumSlots個
+	//合成はスロット（フレーム番号 % NumSlots）ごとの出力先に書き、出力はそれを読む
+	//実行中はフィールドに直接触れないこと。finishの後なら触れてよい
+	//Runs one frame of the field as tasks input -> physics -> injection -> diffusion -> compositing -> export on a TaskGraph.
+	//Compositing and export of frame N proceed alongside input and physics of frame N+1. At most NumSlots frames are in flight.
+	//Compositing writes to a per-slot destination (frame number % NumSlots), and export reads it.
+	//Do not touch the field directly while running. It may be touched after finish.
+	class FramePipeline
+	{
+	public:
+
+		static constexpr size_t NumSlots = 2;
+
+		using CompositeFunction = std::function<void(const Field& field, size_t slot)>;
+
+		using ExportFunction = std::function<void(size_t slot, uint64 frame)>;
+
+		FramePipeline(Field& field, TaskGraph& graph, CompositeFunction composite, ExportFunction exportFrame = ExportFunction())
+			: m_field(field)
+			, m_graph(graph)
+			, m_composite(std::move(composite))
+			, m_export(std::move(exportFrame)) {}
+
+		FramePipeline(const FramePipeline&) = delete;
+		FramePipeline& operator=(const FramePipeline&) = delete;
+
+		~FramePipeline()
+		{
+			//タスクはこのオブジェクトを参照するので、例外が出ていても終わるまで待つ
+			//Tasks refer to this object, so wait for them to finish even if an exception was thrown.
+			try
+			{
+				finish();
+			}
+			catch (...)
+			{
+			}
+		}
+
+		//次のフレームのタスクを登録し、そのフレーム番号を返す
+		//同じスロットを使う2つ前のフレームの出力が終わるまでブロックする。戻った時点で、それより前のフレームはすべて終わっている
+		//Submits the tasks of the next frame and returns its frame number.
+		//Blocks until the export of the frame two before, which uses the same slot, finishes. On return, all frames before it are finished.
+		uint64 submit(const InputSnapshot& input)
+		{
+			const uint64 frame = m_nextFrame;
+			FrameTasks& current = m_frames[frame % NumSlots];
+			const FrameTasks previous = m_frames[(frame + NumSlots - 1) % NumSlots];
+
+			//2つ前のフレームのタスクはここで終わるので、合成の依存に入れなくてよい
+			//Tasks of the frame two before finish here, so compositing need not depend on them.
+			m_graph.wait(current.exporting);
+			++m_nextFrame;
+
+			//壁を書き換える入力は、壁を読む前のフレームの物理・拡散・合成を待つ
+			//Input rewriting walls waits for physics, diffusion and compositing of the previous frame, which read walls.
+			current.input = m_graph.add([this, input]
+			{
+				m_field.applyInput(input);
+			}, input.editsWalls() ? std::vector<TaskGraph::TaskId>{ previous.physics, previous.diffusion, previous.compositing } : std::vector<TaskGraph::TaskId>{});
+
+			current.physics = m_graph.add([this, input]
+			{
+				m_field.moveLights(input);
+			}, { current.input, previous.physics, previous.injection });
+
+			//注入は前のフレームの拡散が使う光源と、合成が描くライトを書き換える
+			//Injection rewrites the sources used by the previous diffusion and the lights drawn by the previous compositing.
+			current.injection = m_graph.add([this]
+			{
+				m_field.collectLightSources();
+			}, { current.physics, previous.diffusion, previous.compositing });
+
+			current.diffusion = m_graph.add([this]
+			{
+				m_field.propagateCollectedLight();
+			}, { current.injection, previous.compositing });
+
+			const size_t slot = frame % NumSlots;
+			current.compositing = m_graph.add([this, slot]
+			{
+				m_composite(m_field, slot);
+			}, { current.diffusion });
+
+			current.exporting = m_graph.add([this, slot, frame]
+			{
+				if (m_export)
+				{
+					m_export(slot, frame);
+				}
+			}, { current.compositing, previous.exporting });
+
+			return frame;
+		}
+
+		//登録済みのフレームの出力が終わるまで待つ。タスクが例外を投げていれば、ここで投げ直す
+		//Waits until the export of a submitted frame finishes. If a task threw an exception, it is rethrown here.
+		void wait(uint64 frame)
+		{
+			if (m_nextFrame <= frame + NumSlots)
+			{
+				m_graph.wait(m_frames[frame % NumSlots].exporting);
+			}
+		}
+
+		//登録したすべてのフレームが終わるまで待つ
+		//Waits until all submitted frames finish.
+		void finish()
+		{
+			if (0 < m_nextFrame)
+			{
+				wait(m_nextFrame - 1);
+			}
+		}
+
+		uint64 numSubmitted()const
+		{
+			return m_nextFrame;
+		}
+
+	private:
+
+		struct FrameTasks
+		{
+			TaskGraph::TaskId input = 0;
+			TaskGraph::TaskId physics = 0;
+			TaskGraph::TaskId injection = 0;
+			TaskGraph::TaskId diffusion = 0;
+			TaskGraph::TaskId compositing = 0;
+			TaskGraph::TaskId exporting = 0;
+		};
+
+		Field& m_field;
+		TaskGraph& m_graph;
+		CompositeFunction m_composite;
+		ExportFunction m_export;
+		std::array<FrameTasks, NumSlots> m_frames;
+		uint64 m_nextFrame = 0;
+	};
+}
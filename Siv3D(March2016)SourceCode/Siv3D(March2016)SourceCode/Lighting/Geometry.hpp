@@ -0,0 +1,466 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+//Siv3Dに依存しないための最小限の数学・色の型
+//名前と使い方はSiv3Dに合わせてあるので、アプリ側では変換するだけでよい
+//Minimal math and colour types so that the core does not depend on Siv3D.
+//Names and usage follow Siv3D, so the application only has to convert them.
+namespace lighting
+{
+	using uint8 = std::uint8_t;
+	using uint32 = std::uint32_t;
+	using int64 = std::int64_t;
+	using uint64 = std::uint64_t;
+
+	struct Vec2;
+
+	struct Point
+	{
+		int x = 0;
+		int y = 0;
+
+		Point() = default;
+
+		constexpr Point(int _x, int _y)
+			: x(_x)
+			, y(_y) {}
+
+		template<class X, class Y>
+		constexpr Point(X _x, Y _y)
+			: x(static_cast<int>(_x))
+			, y(static_cast<int>(_y)) {}
+
+		constexpr Point operator+(const Point& p)const
+		{
+			return{ x + p.x, y + p.y };
+		}
+
+		constexpr Point operator-(const Point& p)const
+		{
+			return{ x - p.x, y - p.y };
+		}
+
+		constexpr Point operator-()const
+		{
+			return{ -x, -y };
+		}
+
+		constexpr Point operator*(int s)const
+		{
+			return{ x*s, y*s };
+		}
+
+		Point& operator+=(const Point& p)
+		{
+			x += p.x;
+			y += p.y;
+			return *this;
+		}
+
+		Point& operator-=(const Point& p)
+		{
+			x -= p.x;
+			y -= p.y;
+			return *this;
+		}
+
+		constexpr bool operator==(const Point& p)const
+		{
+			return x == p.x && y == p.y;
+		}
+
+		constexpr bool operator!=(const Point& p)const
+		{
+			return !(*this == p);
+		}
+	};
+
+	using Size = Point;
+
+	struct Vec2
+	{
+		double x = 0.0;
+		double y = 0.0;
+
+		Vec2() = default;
+
+		constexpr Vec2(double _x, double _y)
+			: x(_x)
+			, y(_y) {}
+
+		constexpr Vec2(const Point& p)
+			: x(p.x)
+			, y(p.y) {}
+
+		constexpr Vec2 operator+(const Vec2& v)const
+		{
+			return{ x + v.x, y + v.y };
+		}
+
+		constexpr Vec2 operator-(const Vec2& v)const
+		{
+			return{ x - v.x, y - v.y };
+		}
+
+		constexpr Vec2 operator-()const
+		{
+			return{ -x, -y };
+		}
+
+		constexpr Vec2 operator*(double s)const
+		{
+			return{ x*s, y*s };
+		}
+
+		constexpr Vec2 operator/(double s)const
+		{
+			return{ x / s, y / s };
+		}
+
+		Vec2& operator+=(const Vec2& v)
+		{
+			x += v.x;
+			y += v.y;
+			return *this;
+		}
+
+		Vec2& operator-=(const Vec2& v)
+		{
+			x -= v.x;
+			y -= v.y;
+			return *this;
+		}
+
+		Vec2& operator*=(double s)
+		{
+			x *= s;
+			y *= s;
+			return *this;
+		}
+
+		Vec2& operator/=(double s)
+		{
+			x /= s;
+			y /= s;
+			return *this;
+		}
+
+		constexpr double dot(const Vec2& v)const
+		{
+			return x*v.x + y*v.y;
+		}
+
+		constexpr double lengthSq()const
+		{
+			return x*x + y*y;
+		}
+
+		double length()const
+		{
+			return std::sqrt(lengthSq());
+		}
+
+		//小数部を切り捨てる
+		//Truncates the fractional part.
+		constexpr Point asPoint()const
+		{
+			return{ static_cast<int>(x), static_cast<int>(y) };
+		}
+	};
+
+	inline constexpr Vec2 operator*(double s, const Vec2& v)
+	{
+		return v*s;
+	}
+
+	struct Rect
+	{
+		int x = 0;
+		int y = 0;
+		int w = 0;
+		int h = 0;
+
+		Rect() = default;
+
+		constexpr Rect(int _x, int _y, int _w, int _h)
+			: x(_x)
+			, y(_y)
+			, w(_w)
+			, h(_h) {}
+
+		constexpr Rect(const Point& pos, const Size& size)
+			: x(pos.x)
+			, y(pos.y)
+			, w(size.x)
+			, h(size.y) {}
+
+		constexpr Point pos()const
+		{
+			return{ x, y };
+		}
+
+		constexpr bool contains(const Point& p)const
+		{
+			return x <= p.x && p.x < x + w && y <= p.y && p.y < y + h;
+		}
+
+		constexpr bool intersects(const Rect& r)const
+		{
+			return x < r.x + r.w && r.x < x + w && y < r.y + r.h && r.y < y + h;
+		}
+	};
+
+	struct Line
+	{
+		Vec2 begin;
+		Vec2 end;
+
+		Line() = default;
+
+		constexpr Line(const Vec2& _begin, const Vec2& _end)
+			: begin(_begin)
+			, end(_end) {}
+	};
+
+	struct RectF
+	{
+		double x = 0.0;
+		double y = 0.0;
+		double w = 0.0;
+		double h = 0.0;
+
+		RectF() = default;
+
+		constexpr RectF(double _x, double _y, double _w, double _h)
+			: x(_x)
+			, y(_y)
+			, w(_w)
+			, h(_h) {}
+
+		constexpr RectF(double _x, double _y, const Size& size)
+			: x(_x)
+			, y(_y)
+			, w(size.x)
+			, h(size.y) {}
+
+		constexpr RectF(const Rect& r)
+			: x(r.x)
+			, y(r.y)
+			, w(r.w)
+			, h(r.h) {}
+
+		constexpr RectF stretched(double d)const
+		{
+			return{ x - d, y - d, w + 2.0*d, h + 2.0*d };
+		}
+
+		constexpr bool contains(const Vec2& p)const
+		{
+			return x <= p.x && p.x < x + w && y <= p.y && p.y < y + h;
+		}
+
+		//線分が長方形と少しでも重なればtrue（Liang-Barskyの切り取り）
+		//True if the segment overlaps the rectangle at all (Liang-Barsky clipping).
+		bool intersects(const Line& line)const
+		{
+			const Vec2 d = line.end - line.begin;
+			const double p[4] = { -d.x, d.x, -d.y, d.y };
+			const double q[4] = { line.begin.x - x, x + w - line.begin.x, line.begin.y - y, y + h - line.begin.y };
+
+			double t0 = 0.0;
+			double t1 = 1.0;
+			for (int i = 0; i < 4; ++i)
+			{
+				if (p[i] == 0.0)
+				{
+					if (q[i] < 0.0)
+					{
+						return false;
+					}
+				}
+				else
+				{
+					const double t = q[i] / p[i];
+					if (p[i] < 0.0)
+					{
+						t0 = std::max(t0, t);
+					}
+					else
+					{
+						t1 = std::min(t1, t);
+					}
+				}
+			}
+
+			return t0 <= t1;
+		}
+	};
+
+	struct Circle
+	{
+		Vec2 center;
+		double r = 0.0;
+
+		Circle() = default;
+
+		constexpr Circle(const Vec2& _center, double _r)
+			: center(_center)
+			, r(_r) {}
+	};
+
+	struct ColorF
+	{
+		double r = 0.0;
+		double g = 0.0;
+		double b = 0.0;
+		double a = 1.0;
+
+		ColorF() = default;
+
+		constexpr ColorF(double _r, double _g, double _b, double _a = 1.0)
+			: r(_r)
+			, g(_g)
+			, b(_b)
+			, a(_a) {}
+
+		explicit constexpr ColorF(double gray)
+			: r(gray)
+			, g(gray)
+			, b(gray)
+			, a(1.0) {}
+
+		//アルファは掛けない
+		//Alpha is not multiplied.
+		constexpr ColorF operator*(double s)const
+		{
+			return{ r*s, g*s, b*s, a };
+		}
+	};
+
+	//色相[deg]・彩度・明度で表した色
+	//Colour represented by hue [deg], saturation and value.
+	struct HSV
+	{
+		double h = 0.0;
+		double s = 0.0;
+		double v = 0.0;
+
+		HSV() = default;
+
+		constexpr HSV(double _h, double _s, double _v)
+			: h(_h)
+			, s(_s)
+			, v(_v) {}
+
+		operator ColorF()const
+		{
+			const double hue = std::fmod(std::fmod(h, 360.0) + 360.0, 360.0) / 60.0;
+			const double chroma = v*s;
+			const double x = chroma*(1.0 - std::fabs(std::fmod(hue, 2.0) - 1.0));
+			const double m = v - chroma;
+
+			const int sector = static_cast<int>(hue);
+			const double r[6] = { chroma, x, 0.0, 0.0, x, chroma };
+			const double g[6] = { x, chroma, chroma, x, 0.0, 0.0 };
+			const double b[6] = { 0.0, 0.0, x, chroma, chroma, x };
+			return ColorF(r[sector % 6] + m, g[sector % 6] + m, b[sector % 6] + m);
+		}
+	};
+
+	namespace Palette
+	{
+		constexpr ColorF Black{ 0.0, 0.0, 0.0 };
+		constexpr ColorF White{ 1.0, 1.0, 1.0 };
+	}
+
+	template<class T>
+	inline constexpr const T& Max(const T& a, const T& b)
+	{
+		return a < b ? b : a;
+	}
+
+	template<class T>
+	inline constexpr const T& Min(const T& a, const T& b)
+	{
+		return b < a ? b : a;
+	}
+
+	template<class T>
+	inline constexpr const T& Clamp(const T& x, const T& min, const T& max)
+	{
+		return x < min ? min : max < x ? max : x;
+	}
+
+	inline int Abs(int x)
+	{
+		return std::abs(x);
+	}
+
+	inline double Abs(double x)
+	{
+		return std::fabs(x);
+	}
+
+	inline double Sqrt(double x)
+	{
+		return std::sqrt(x);
+	}
+
+	inline double Floor(double x)
+	{
+		return std::floor(x);
+	}
+
+	inline double Ceil(double x)
+	{
+		return std::ceil(x);
+	}
+
+	inline double Exp(double x)
+	{
+		return std::exp(x);
+	}
+
+	//乱数はすべてこのエンジンから取る。スレッドごとに固定のシードで始まるので、ヘッドレスの実行は再現できる
+	//All random numbers come from this engine. It starts from a fixed seed per thread, so headless runs are reproducible.
+	inline std::mt19937& RandomEngine()
+	{
+		thread_local std::mt19937 engine(5489u);
+		return engine;
+	}
+
+	inline double Random(double min, double max, std::mt19937& engine = RandomEngine())
+	{
+		return std::uniform_real_distribution<double>(min, max)(engine);
+	}
+
+	inline bool RandomBool(double p = 0.5)
+	{
+		return Random(0.0, 1.0) < p;
+	}
+
+	//長さlengthのランダムな向きのベクトル
+	//Vector of the given length in a random direction.
+	inline Vec2 RandomVec2(double length, std::mt19937& engine = RandomEngine())
+	{
+		const double angle = Random(0.0, 6.283185307179586, engine);
+		return Vec2(std::cos(angle)*length, std::sin(angle)*length);
+	}
+
+	inline Vec2 RandomVec2(const RectF& rect, std::mt19937& engine = RandomEngine())
+	{
+		return Vec2(Random(rect.x, rect.x + rect.w, engine), Random(rect.y, rect.y + rect.h, engine));
+	}
+}
@@ -0,0 +1,517 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "Geometry.hpp"
+
+namespace lighting
+{
+	template<class T>
+	class DoubleBuffer
+	{
+	public:
+
+		DoubleBuffer() {}
+
+		DoubleBuffer(const T& initial) :m_buffer({ initial, initial }) {}
+
+		void flip()
+		{
+			if (m_singleBuffered)
+			{
+				return;
+			}
+
+			m_currentWriteBuffer = (m_currentWriteBuffer + 1) % m_buffer.size();
+		}
+
+		T& write()
+		{
+			return m_buffer[m_singleBuffered ? readIndex() : writeIndex()];
+		}
+
+		const T& read()const
+		{
+			return m_buffer[readIndex()];
+		}
+
+		//読み出し側のバッファを直接書き換える（その場で更新する処理用）
+		//Writable reference to the read side buffer (for in-place updates).
+		T& current()
+		{
+			return m_buffer[readIndex()];
+		}
+
+		//書き込み側のバッファを解放し、write()が読み出し側を指すようにする（flipは何もしなくなる）
+		//Release the write side buffer and make write() refer to the read side (flip does nothing).
+		void setSingleBuffered(bool single)
+		{
+			if (single == m_singleBuffered)
+			{
+				return;
+			}
+
+			m_singleBuffered = single;
+			m_buffer[writeIndex()] = single ? T() : m_buffer[readIndex()];
+		}
+
+		bool isSingleBuffered()const
+		{
+			return m_singleBuffered;
+		}
+
+	private:
+
+		int writeIndex()const
+		{
+			return m_currentWriteBuffer;
+		}
+
+		int readIndex()const
+		{
+			return (m_currentWriteBuffer + 1) % m_buffer.size();
+		}
+
+		std::array<T, 2> m_buffer;
+		int m_currentWriteBuffer = 0;
+		bool m_singleBuffered = false;
+	};
+
+	//Grid2Dの1行への参照
+	//Reference to a row of Grid2D.
+	template<class T>
+	class GridRow
+	{
+	public:
+
+		GridRow(T* data, size_t size)
+			: m_data(data)
+			, m_size(size) {}
+
+		T& operator[](size_t x)const
+		{
+			return m_data[x];
+		}
+
+		T* begin()const
+		{
+			return m_data;
+		}
+
+		T* end()const
+		{
+			return m_data + m_size;
+		}
+
+		T* data()const
+		{
+			return m_data;
+		}
+
+		size_t size()const
+		{
+			return m_size;
+		}
+
+	private:
+
+		T* m_data;
+		size_t m_size;
+	};
+
+	//セルを行優先で1つの配列に詰めた2次元グリッド。y行目はdata() + y*width()から始まる
+	//2D grid packing cells row-major into one array. Row y starts at data() + y*width().
+	template<class T>
+	class Grid2D
+	{
+	public:
+
+		Grid2D() {}
+
+		Grid2D(size_t x, size_t y)
+			: m_width(x)
+			, m_height(y)
+			, m_cells(x*y)
+		{}
+
+		Grid2D(size_t x, size_t y, const T& value)
+			: m_width(x)
+			, m_height(y)
+			, m_cells(x*y, value)
+		{}
+
+		void resize(size_t x, size_t y)
+		{
+			resize(x, y, T());
+		}
+
+		//重なる範囲のセルは値を保つ
+		//Cells in the overlapping range keep their values.
+		void resize(size_t x, size_t y, const T& value)
+		{
+			std::vector<T> cells(x*y, value);
+			for (size_t row = 0; row < Min(y, m_height); ++row)
+			{
+				std::copy(m_cells.begin() + row*m_width, m_cells.begin() + row*m_width + Min(x, m_width), cells.begin() + row*x);
+			}
+
+			m_cells.swap(cells);
+			m_width = x;
+			m_height = y;
+		}
+
+		void reset(const T& value)
+		{
+			std::fill(m_cells.begin(), m_cells.end(), value);
+		}
+
+		//GridExpression.hppの式を一時グリッドを作らずに1回の走査で評価して代入する
+		//Evaluates an expression of GridExpression.hpp in a single pass without temporary grids, and assigns it.
+		template<class Expression, class = typename Expression::GridExpressionTag>
+		Grid2D& operator=(const Expression& expression)
+		{
+			expression.evaluateTo(*this);
+			return *this;
+		}
+
+		GridRow<T> operator[](size_t y)
+		{
+			return GridRow<T>(m_cells.data() + y*m_width, m_width);
+		}
+
+		GridRow<const T> operator[](size_t y)const
+		{
+			return GridRow<const T>(m_cells.data() + y*m_width, m_width);
+		}
+
+		T& operator[](const Point& p)
+		{
+			return m_cells[p.y*m_width + p.x];
+		}
+
+		const T& operator[](const Point& p)const
+		{
+			return m_cells[p.y*m_width + p.x];
+		}
+
+		bool isValid(const Point& p)const
+		{
+			return 0 <= p.y && p.y < static_cast<int>(m_height)
+				&& 0 <= p.x && p.x < static_cast<int>(m_width);
+		}
+
+		size_t width()const
+		{
+			return m_width;
+		}
+
+		size_t height()const
+		{
+			return m_height;
+		}
+
+		T* data()
+		{
+			return m_cells.data();
+		}
+
+		const T* data()const
+		{
+			return m_cells.data();
+		}
+
+	private:
+
+		size_t m_width = 0;
+		size_t m_height = 0;
+		std::vector<T> m_cells;
+	};
+
+	//最下位の立っているビットの位置（wordは0でないこと）
+	//_BitScanForward64はx64とARM64にしかないので、Win32では32ビットずつ調べる
+	//Position of the lowest set bit (word must not be 0).
+	//_BitScanForward64 exists only on x64 and ARM64, so Win32 scans 32 bits at a time.
+	inline size_t CountTrailingZeros(uint64 word)
+	{
+	#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return index;
+	#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+		{
+			return index;
+		}
+		_BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+		return 32 + index;
+	#else
+		return static_cast<size_t>(__builtin_ctzll(word));
+	#endif
+	}
+
+	//1セル1ビットで詰めた2次元グリッド
+	//行単位の範囲操作は64ビットのワード演算でまとめて行う
+	//2D grid packing one cell into one bit.
+	//Range operations over a row are done with 64bit word operations.
+	class BitGrid2D
+	{
+	public:
+
+		using Word = uint64;
+
+		static const size_t WordBits = 64;
+
+		BitGrid2D() {}
+
+		BitGrid2D(size_t x, size_t y, bool value = false)
+			: m_width(x)
+			, m_height(y)
+			, m_wordsPerRow((x + WordBits - 1) / WordBits)
+			, m_words(m_wordsPerRow*y, value ? ~Word(0) : Word(0))
+		{
+			for (size_t i = 0; i < m_height; ++i)
+			{
+				clearPadding(i);
+			}
+		}
+
+		template<class T, class Predicate>
+		BitGrid2D(const Grid2D<T>& grid, Predicate isSet)
+			: BitGrid2D(grid.width(), grid.height())
+		{
+			for (size_t y = 0; y < m_height; ++y)
+			{
+				for (size_t x = 0; x < m_width; ++x)
+				{
+					if (isSet(grid[y][x]))
+					{
+						set(x, y, true);
+					}
+				}
+			}
+		}
+
+		bool get(size_t x, size_t y)const
+		{
+			return ((m_words[y*m_wordsPerRow + x / WordBits] >> (x % WordBits)) & 1u) != 0;
+		}
+
+		bool operator[](const Point& p)const
+		{
+			return get(p.x, p.y);
+		}
+
+		void set(size_t x, size_t y, bool value)
+		{
+			apply(m_words[y*m_wordsPerRow + x / WordBits], Word(1) << (x % WordBits), value);
+		}
+
+		//[beginX, endX) の範囲をまとめて書き換える
+		//Overwrite range [beginX, endX) at once.
+		void fillSpan(size_t y, size_t beginX, size_t endX, bool value)
+		{
+			if (endX <= beginX)
+			{
+				return;
+			}
+
+			Word* line = row(y);
+			const size_t first = beginX / WordBits;
+			const size_t last = (endX - 1) / WordBits;
+			const Word headMask = ~Word(0) << (beginX % WordBits);
+			const Word tailMask = ~Word(0) >> (WordBits - 1 - (endX - 1) % WordBits);
+
+			if (first == last)
+			{
+				apply(line[first], headMask & tailMask, value);
+				return;
+			}
+
+			apply(line[first], headMask, value);
+			for (size_t i = first + 1; i < last; ++i)
+			{
+				line[i] = value ? ~Word(0) : Word(0);
+			}
+			apply(line[last], tailMask, value);
+		}
+
+		//範囲外ははみ出した部分を切り捨てる
+		//Parts outside the grid are clipped.
+		void fillRect(const Rect& rect, bool value)
+		{
+			const int beginX = Max(rect.x, 0);
+			const int beginY = Max(rect.y, 0);
+			const int endX = Min(rect.x + rect.w, static_cast<int>(m_width));
+			const int endY = Min(rect.y + rect.h, static_cast<int>(m_height));
+			if (endX <= beginX)
+			{
+				return;
+			}
+
+			for (int y = beginY; y < endY; ++y)
+			{
+				fillSpan(y, beginX, endX, value);
+			}
+		}
+
+		//patternの立っているビットをposだけずらして書き込む
+		//Write set bits of pattern shifted by pos.
+		void blit(const BitGrid2D& pattern, const Point& pos, bool value)
+		{
+			for (size_t py = 0; py < pattern.height(); ++py)
+			{
+				const int y = pos.y + static_cast<int>(py);
+				if (y < 0 || static_cast<int>(m_height) <= y)
+				{
+					continue;
+				}
+
+				Word* line = row(y);
+				const Word* source = pattern.row(py);
+				for (size_t i = 0; i < pattern.wordsPerRow(); ++i)
+				{
+					const Word word = source[i];
+					if (word == 0)
+					{
+						continue;
+					}
+
+					const long long bitPos = pos.x + static_cast<long long>(i*WordBits);
+					if (bitPos < 0)
+					{
+						if (-bitPos < static_cast<long long>(WordBits) && 0 < m_wordsPerRow)
+						{
+							apply(line[0], word >> (-bitPos), value);
+						}
+						continue;
+					}
+
+					const size_t index = static_cast<size_t>(bitPos) / WordBits;
+					const size_t offset = static_cast<size_t>(bitPos) % WordBits;
+					if (index < m_wordsPerRow)
+					{
+						apply(line[index], word << offset, value);
+					}
+					if (offset != 0 && index + 1 < m_wordsPerRow)
+					{
+						apply(line[index + 1], word >> (WordBits - offset), value);
+					}
+				}
+
+				clearPadding(y);
+			}
+		}
+
+		Word* row(size_t y)
+		{
+			return m_words.data() + y*m_wordsPerRow;
+		}
+
+		const Word* row(size_t y)const
+		{
+			return m_words.data() + y*m_wordsPerRow;
+		}
+
+		bool isValid(const Point& p)const
+		{
+			return 0 <= p.x && p.x < static_cast<int>(m_width)
+				&& 0 <= p.y && p.y < static_cast<int>(m_height);
+		}
+
+		size_t width()const
+		{
+			return m_width;
+		}
+
+		size_t height()const
+		{
+			return m_height;
+		}
+
+		size_t wordsPerRow()const
+		{
+			return m_wordsPerRow;
+		}
+
+		//y行目でvalueが続く区間 [begin, end) を左から順に列挙する
+		//Enumerate runs [begin, end) of value in row y from left to right.
+		template<class Func>
+		void forEachRun(size_t y, bool value, Func func)const
+		{
+			const Word* line = row(y);
+			size_t x = 0;
+			while (x < m_width)
+			{
+				const size_t begin = findBit(line, x, value);
+				if (m_width <= begin)
+				{
+					break;
+				}
+
+				const size_t end = findBit(line, begin, !value);
+				func(begin, end);
+				x = end;
+			}
+		}
+
+	private:
+
+		//x以降で最初にvalueになるビットの位置。なければwidthを返す
+		//Position of the first bit equal to value at or after x. Returns width if there is none.
+		size_t findBit(const Word* line, size_t x, bool value)const
+		{
+			size_t index = x / WordBits;
+			Word word = (value ? line[index] : ~line[index]) & (~Word(0) << (x % WordBits));
+			while (word == 0)
+			{
+				if (++index == m_wordsPerRow)
+				{
+					return m_width;
+				}
+				word = value ? line[index] : ~line[index];
+			}
+			return Min(index*WordBits + CountTrailingZeros(word), m_width);
+		}
+
+		static void apply(Word& word, Word mask, bool value)
+		{
+			if (value)
+			{
+				word |= mask;
+			}
+			else
+			{
+				word &= ~mask;
+			}
+		}
+
+		//幅を超えた末尾のビットは常に0にしておく
+		//Bits beyond the width are always kept zero.
+		void clearPadding(size_t y)
+		{
+			const size_t usedBits = m_width % WordBits;
+			if (usedBits != 0)
+			{
+				row(y)[m_wordsPerRow - 1] &= ~(~Word(0) << usedBits);
+			}
+		}
+
+		size_t m_width = 0;
+		size_t m_height = 0;
+		size_t m_wordsPerRow = 0;
+		std::vector<Word> m_words;
+	};
+}
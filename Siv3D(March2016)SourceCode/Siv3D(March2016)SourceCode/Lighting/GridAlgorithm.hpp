@@ -0,0 +1,376 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <cassert>
+#include <vector>
+#include "CellRegion.hpp"
+#include "Grid2D.hpp"
+#include "Parallel.hpp"
+
+//ループの反復が互いに依存しないことをコンパイラに伝え、ベクトル化を促す
+//Tells the compiler that loop iterations do not depend on each other, encouraging vectorization.
+#if defined(_MSC_VER)
+#	define LIGHTING_INDEPENDENT_LOOP __pragma(loop(ivdep))
+#elif defined(__clang__)
+#	define LIGHTING_INDEPENDENT_LOOP _Pragma("clang loop vectorize(enable)")
+#elif defined(__GNUC__)
+#	define LIGHTING_INDEPENDENT_LOOP _Pragma("GCC ivdep")
+#else
+#	define LIGHTING_INDEPENDENT_LOOP
+#endif
+
+namespace lighting
+{
+	//グリッドのアルゴリズムの実行方針。std::executionに倣う
+	//Execution policies of grid algorithms, modelled on std::execution.
+	namespace execution
+	{
+		//呼び出したスレッドで順に処理する
+		//Processes in order on the calling thread.
+		class SequencedPolicy
+		{
+		};
+
+		//行やセルの範囲に分けてExecutorで並列に処理する。on()で別のExecutorを使う
+		//Processes ranges of rows or cells in parallel on an Executor. on() selects another executor.
+		class ParallelPolicy
+		{
+		public:
+
+			constexpr ParallelPolicy(Executor* executor = nullptr, size_t minCellsPerTask = 4096)
+				: m_executor(executor)
+				, m_minCellsPerTask(minCellsPerTask) {}
+
+			ParallelPolicy on(Executor& executor)const
+			{
+				return ParallelPolicy(&executor, m_minCellsPerTask);
+			}
+
+			Executor& executor()const
+			{
+				return m_executor ? *m_executor : DefaultExecutor();
+			}
+
+			//1つのタスクが受け持つセルの最小数。小さなグリッドではタスクに分けない
+			//Minimum number of cells a task takes. Small grids are not split into tasks.
+			size_t minCellsPerTask()const
+			{
+				return m_minCellsPerTask;
+			}
+
+		private:
+
+			Executor* m_executor;
+			size_t m_minCellsPerTask;
+		};
+
+		//ParallelPolicyに加えて、各範囲の中のセルをベクトル化してよい。関数は同じ範囲の他のセルに触れないこと
+		//In addition to ParallelPolicy, cells within each range may be vectorized. Functions must not touch other cells of the same range.
+		class ParallelUnsequencedPolicy : public ParallelPolicy
+		{
+		public:
+
+			constexpr ParallelUnsequencedPolicy(Executor* executor = nullptr, size_t minCellsPerTask = 4096)
+				: ParallelPolicy(executor, minCellsPerTask) {}
+
+			ParallelUnsequencedPolicy on(Executor& executor)const
+			{
+				return ParallelUnsequencedPolicy(&executor, minCellsPerTask());
+			}
+		};
+
+		constexpr SequencedPolicy seq{};
+
+		constexpr ParallelPolicy par{};
+
+		constexpr ParallelUnsequencedPolicy par_unseq{};
+	}
+
+	namespace detail
+	{
+		inline size_t ChunkCount(const execution::SequencedPolicy&, size_t, size_t)
+		{
+			return 1;
+		}
+
+		inline size_t ChunkCount(const execution::ParallelPolicy& policy, size_t count, size_t cellsPerItem)
+		{
+			return policy.executor().chunkCount(count, Max<size_t>(policy.minCellsPerTask() / Max<size_t>(cellsPerItem, 1u), 1u));
+		}
+
+		template<class Func>
+		void RunChunks(const execution::SequencedPolicy&, size_t count, size_t, const Func& func)
+		{
+			func(size_t(0), size_t(0), count);
+		}
+
+		template<class Func>
+		void RunChunks(const execution::ParallelPolicy& policy, size_t count, size_t numChunks, const Func& func)
+		{
+			policy.executor().parallelForChunks(count, numChunks, func);
+		}
+
+		template<class Func>
+		void Loop(const execution::SequencedPolicy&, size_t begin, size_t end, Func& func)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				func(i);
+			}
+		}
+
+		template<class Func>
+		void Loop(const execution::ParallelPolicy&, size_t begin, size_t end, Func& func)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				func(i);
+			}
+		}
+
+		template<class Func>
+		void Loop(const execution::ParallelUnsequencedPolicy&, size_t begin, size_t end, Func& func)
+		{
+			LIGHTING_INDEPENDENT_LOOP
+			for (size_t i = begin; i < end; ++i)
+			{
+				func(i);
+			}
+		}
+
+		//グリッド全体は行の区切りを無視して、連続したセルの範囲に分ける
+		//The whole grid ignores row boundaries and is split into contiguous ranges of cells.
+		class WholeGrid
+		{
+		};
+
+		//Rectはグリッドの外にはみ出した部分を切り捨てる。CellRegionは正規化済みであること
+		//ForEachRangeはfunc(chunk, begin, end)に、行優先で数えたセルの添字の範囲を渡す
+		//Rect is clipped to the grid. CellRegion must be normalized.
+		//ForEachRange passes ranges of row-major cell indices to func(chunk, begin, end).
+		template<class Policy>
+		size_t RangeChunkCount(const Policy& policy, size_t width, size_t height, const WholeGrid&)
+		{
+			return ChunkCount(policy, width*height, 1);
+		}
+
+		template<class Policy, class Func>
+		void ForEachRange(const Policy& policy, size_t width, size_t height, const WholeGrid&, size_t numChunks, const Func& func)
+		{
+			RunChunks(policy, width*height, numChunks, func);
+		}
+
+		inline Rect ClipRect(const Rect& rect, size_t width, size_t height)
+		{
+			const int beginX = Max(rect.x, 0);
+			const int beginY = Max(rect.y, 0);
+			const int endX = Min(rect.x + rect.w, static_cast<int>(width));
+			const int endY = Min(rect.y + rect.h, static_cast<int>(height));
+			return Rect(beginX, beginY, Max(endX - beginX, 0), Max(endY - beginY, 0));
+		}
+
+		template<class Policy>
+		size_t RangeChunkCount(const Policy& policy, size_t width, size_t height, const Rect& rect)
+		{
+			const Rect clipped = ClipRect(rect, width, height);
+			return ChunkCount(policy, static_cast<size_t>(clipped.h), static_cast<size_t>(clipped.w));
+		}
+
+		template<class Policy, class Func>
+		void ForEachRange(const Policy& policy, size_t width, size_t height, const Rect& rect, size_t numChunks, const Func& func)
+		{
+			const Rect clipped = ClipRect(rect, width, height);
+			if (clipped.w == 0 || clipped.h == 0)
+			{
+				return;
+			}
+
+			RunChunks(policy, static_cast<size_t>(clipped.h), numChunks, [&](size_t chunk, size_t beginRow, size_t endRow)
+			{
+				for (size_t row = beginRow; row < endRow; ++row)
+				{
+					const size_t offset = (clipped.y + row)*width + clipped.x;
+					func(chunk, offset, offset + clipped.w);
+				}
+			});
+		}
+
+		template<class Policy>
+		size_t RangeChunkCount(const Policy& policy, size_t width, size_t height, const CellRegion& region)
+		{
+			return ChunkCount(policy, Min(region.height(), height), width);
+		}
+
+		template<class Policy, class Func>
+		void ForEachRange(const Policy& policy, size_t width, size_t height, const CellRegion& region, size_t numChunks, const Func& func)
+		{
+			RunChunks(policy, Min(region.height(), height), numChunks, [&](size_t chunk, size_t beginRow, size_t endRow)
+			{
+				for (size_t y = beginRow; y < endRow; ++y)
+				{
+					for (const auto& span : region.row(y))
+					{
+						func(chunk, y*width + span.begin, y*width + span.end);
+					}
+				}
+			});
+		}
+
+		template<class Policy, class T, class Region, class Func>
+		void ForEachCell(const Policy& policy, Grid2D<T>& grid, const Region& region, Func func)
+		{
+			T* cells = grid.data();
+			const size_t numChunks = RangeChunkCount(policy, grid.width(), grid.height(), region);
+			ForEachRange(policy, grid.width(), grid.height(), region, numChunks, [&](size_t, size_t begin, size_t end)
+			{
+				auto body = [&](size_t i)
+				{
+					func(cells[i]);
+				};
+				Loop(policy, begin, end, body);
+			});
+		}
+
+		template<class Policy, class T, class U, class Region, class Func>
+		void Transform(const Policy& policy, const Grid2D<T>& source, Grid2D<U>& destination, const Region& region, Func func)
+		{
+			assert(source.width() == destination.width() && source.height() == destination.height());
+			const T* in = source.data();
+			U* out = destination.data();
+			const size_t numChunks = RangeChunkCount(policy, source.width(), source.height(), region);
+			ForEachRange(policy, source.width(), source.height(), region, numChunks, [&](size_t, size_t begin, size_t end)
+			{
+				auto body = [&](size_t i)
+				{
+					out[i] = func(in[i]);
+				};
+				Loop(policy, begin, end, body);
+			});
+		}
+
+		//チャンクごとに部分的な結果を作り、最後にinitからチャンクの順に畳み込む
+		//チャンクの数が同じなら結果も同じになる。reduceは結合的かつ可換であること
+		//Builds a partial result per chunk and folds them from init in chunk order at the end.
+		//The same number of chunks gives the same result. reduce must be associative and commutative.
+		template<class Policy, class T, class Region, class U, class ReduceOp, class TransformOp>
+		U TransformReduce(const Policy& policy, const Grid2D<T>& grid, const Region& region, U init, ReduceOp reduce, TransformOp transform)
+		{
+			const T* cells = grid.data();
+			const size_t numChunks = RangeChunkCount(policy, grid.width(), grid.height(), region);
+			std::vector<U> partials(numChunks, init);
+			std::vector<char> hasPartial(numChunks, false);
+			ForEachRange(policy, grid.width(), grid.height(), region, numChunks, [&](size_t chunk, size_t begin, size_t end)
+			{
+				if (begin == end)
+				{
+					return;
+				}
+
+				U partial = hasPartial[chunk] ? reduce(partials[chunk], transform(cells[begin])) : U(transform(cells[begin]));
+				for (size_t i = begin + 1; i < end; ++i)
+				{
+					partial = reduce(partial, transform(cells[i]));
+				}
+				partials[chunk] = partial;
+				hasPartial[chunk] = true;
+			});
+
+			for (size_t chunk = 0; chunk < numChunks; ++chunk)
+			{
+				if (hasPartial[chunk])
+				{
+					init = reduce(init, partials[chunk]);
+				}
+			}
+			return init;
+		}
+
+		struct Identity
+		{
+			template<class T>
+			const T& operator()(const T& value)const
+			{
+				return value;
+			}
+		};
+	}
+
+	//グリッドのセルにfunc(T&)を適用する。regionにはRectか正規化済みのCellRegionを渡し、その中のセルだけを処理する
+	//並列の方針ではfuncが別々のスレッドから同時に呼ばれる
+	//Applies func(T&) to cells of the grid. region takes a Rect or a normalized CellRegion and limits processing to cells inside it.
+	//With parallel policies func is called from different threads at the same time.
+	template<class Policy, class T, class Func>
+	void ForEachCell(const Policy& policy, Grid2D<T>& grid, Func func)
+	{
+		detail::ForEachCell(policy, grid, detail::WholeGrid(), func);
+	}
+
+	template<class Policy, class T, class Region, class Func>
+	void ForEachCell(const Policy& policy, Grid2D<T>& grid, const Region& region, Func func)
+	{
+		detail::ForEachCell(policy, grid, region, func);
+	}
+
+	//セルをすべてvalueにする
+	//Sets all cells to value.
+	template<class Policy, class T>
+	void Fill(const Policy& policy, Grid2D<T>& grid, const T& value)
+	{
+		detail::ForEachCell(policy, grid, detail::WholeGrid(), [&value](T& cell) { cell = value; });
+	}
+
+	template<class Policy, class T, class Region>
+	void Fill(const Policy& policy, Grid2D<T>& grid, const Region& region, const T& value)
+	{
+		detail::ForEachCell(policy, grid, region, [&value](T& cell) { cell = value; });
+	}
+
+	//destination[p] = func(source[p])。2つのグリッドは同じ大きさであること
+	//destination[p] = func(source[p]). The two grids must have the same size.
+	template<class Policy, class T, class U, class Func>
+	void Transform(const Policy& policy, const Grid2D<T>& source, Grid2D<U>& destination, Func func)
+	{
+		detail::Transform(policy, source, destination, detail::WholeGrid(), func);
+	}
+
+	template<class Policy, class T, class U, class Region, class Func>
+	void Transform(const Policy& policy, const Grid2D<T>& source, Grid2D<U>& destination, const Region& region, Func func)
+	{
+		detail::Transform(policy, source, destination, region, func);
+	}
+
+	//セルをreduceで畳み込む。reduceは結合的かつ可換であること
+	//Folds cells with reduce. reduce must be associative and commutative.
+	template<class Policy, class T, class U, class ReduceOp>
+	U Reduce(const Policy& policy, const Grid2D<T>& grid, U init, ReduceOp reduce)
+	{
+		return detail::TransformReduce(policy, grid, detail::WholeGrid(), init, reduce, detail::Identity());
+	}
+
+	template<class Policy, class T, class Region, class U, class ReduceOp>
+	U Reduce(const Policy& policy, const Grid2D<T>& grid, const Region& region, U init, ReduceOp reduce)
+	{
+		return detail::TransformReduce(policy, grid, region, init, reduce, detail::Identity());
+	}
+
+	//各セルをtransformで変換してからreduceで畳み込む
+	//Transforms each cell with transform, then folds them with reduce.
+	template<class Policy, class T, class U, class ReduceOp, class TransformOp>
+	U TransformReduce(const Policy& policy, const Grid2D<T>& grid, U init, ReduceOp reduce, TransformOp transform)
+	{
+		return detail::TransformReduce(policy, grid, detail::WholeGrid(), init, reduce, transform);
+	}
+
+	template<class Policy, class T, class Region, class U, class ReduceOp, class TransformOp>
+	U TransformReduce(const Policy& policy, const Grid2D<T>& grid, const Region& region, U init, ReduceOp reduce, TransformOp transform)
+	{
+		return detail::TransformReduce(policy, grid, region, init, reduce, transform);
+	}
+}
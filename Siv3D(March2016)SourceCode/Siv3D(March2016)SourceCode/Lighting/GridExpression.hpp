@@ -0,0 +1,437 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <cassert>
+#include <type_traits>
+#include "GridAlgorithm.hpp"
+
+namespace lighting
+{
+	//セルごとの演算を組み合わせた式。代入されるまで評価せず、代入時に1回の走査でまとめて計算する
+	//例: lightmap = Select(walls, ColorF(0, 0, 0), Maximum(staticLight, dynamicLight) * exposure);
+	//Grid2D, 式、スカラー（数値やColorF）を組み合わせられる。スカラーは全セルに同じ値として広がる
+	//ColorF同士の演算はr, g, bごとに行い、アルファは左辺のものを使う
+	//An expression combining per-cell operations. It is not evaluated until assigned, and then computed in a single pass.
+	//Example: lightmap = Select(walls, ColorF(0, 0, 0), Maximum(staticLight, dynamicLight) * exposure);
+	//Grid2D, expressions and scalars (numbers or ColorF) can be combined. Scalars broadcast the same value to all cells.
+	//Operations between ColorF work per r, g and b, and take alpha from the left-hand side.
+	template<class Derived>
+	class GridExpression
+	{
+	public:
+
+		using GridExpressionTag = void;
+
+		const Derived& derived()const
+		{
+			return static_cast<const Derived&>(*this);
+		}
+
+		//Grid2Dへの代入から呼ばれる
+		//Called from assignment to Grid2D.
+		template<class T>
+		void evaluateTo(Grid2D<T>& destination)const;
+	};
+
+	namespace detail
+	{
+		//行優先で数えたセルの添字でgridを読む
+		//Reads grid by row-major cell index.
+		template<class T>
+		class GridOperand : public GridExpression<GridOperand<T>>
+		{
+		public:
+
+			explicit GridOperand(const Grid2D<T>& grid)
+				: m_cells(grid.data())
+				, m_width(grid.width())
+				, m_height(grid.height()) {}
+
+			const T& operator()(size_t i)const
+			{
+				return m_cells[i];
+			}
+
+			size_t width()const
+			{
+				return m_width;
+			}
+
+			size_t height()const
+			{
+				return m_height;
+			}
+
+		private:
+
+			const T* m_cells;
+			size_t m_width;
+			size_t m_height;
+		};
+
+		//すべてのセルで同じ値。大きさを持たず、組み合わせた相手の大きさに合わせる
+		//The same value in all cells. It has no size and follows the size of what it is combined with.
+		template<class T>
+		class ScalarOperand : public GridExpression<ScalarOperand<T>>
+		{
+		public:
+
+			explicit ScalarOperand(const T& value)
+				: m_value(value) {}
+
+			const T& operator()(size_t)const
+			{
+				return m_value;
+			}
+
+			size_t width()const
+			{
+				return 0;
+			}
+
+			size_t height()const
+			{
+				return 0;
+			}
+
+		private:
+
+			T m_value;
+		};
+
+		template<class X>
+		struct IsGridLike
+		{
+			template<class Y>
+			static std::true_type check(typename Y::GridExpressionTag*);
+
+			template<class Y>
+			static std::false_type check(...);
+
+			static const bool value = decltype(check<X>(nullptr))::value;
+		};
+
+		template<class T>
+		struct IsGridLike<Grid2D<T>> : std::true_type
+		{
+		};
+
+		//少なくとも一方がグリッドか式のときだけ、演算子を式として扱う
+		//Operators are treated as expressions only when at least one side is a grid or an expression.
+		template<class A, class B>
+		using EnableIfGridOperands = typename std::enable_if<IsGridLike<A>::value || IsGridLike<B>::value>::type;
+
+		template<class T>
+		GridOperand<T> AsOperand(const Grid2D<T>& grid)
+		{
+			return GridOperand<T>(grid);
+		}
+
+		template<class Derived>
+		const Derived& AsOperand(const GridExpression<Derived>& expression)
+		{
+			return expression.derived();
+		}
+
+		template<class T, class = typename std::enable_if<!IsGridLike<T>::value>::type>
+		ScalarOperand<T> AsOperand(const T& value)
+		{
+			return ScalarOperand<T>(value);
+		}
+
+		template<class X>
+		using OperandType = typename std::decay<decltype(AsOperand(std::declval<const X&>()))>::type;
+
+		//どちらか大きさを持つ方に合わせる。両方持つなら一致していること
+		//Follows whichever has a size. If both do, they must match.
+		inline size_t CommonExtent(size_t a, size_t b)
+		{
+			assert(a == 0 || b == 0 || a == b);
+			return a != 0 ? a : b;
+		}
+
+		template<class A, class B>
+		auto Add(const A& a, const B& b) -> decltype(a + b)
+		{
+			return a + b;
+		}
+
+		inline ColorF Add(const ColorF& a, const ColorF& b)
+		{
+			return ColorF(a.r + b.r, a.g + b.g, a.b + b.b, a.a);
+		}
+
+		template<class A, class B>
+		auto Subtract(const A& a, const B& b) -> decltype(a - b)
+		{
+			return a - b;
+		}
+
+		inline ColorF Subtract(const ColorF& a, const ColorF& b)
+		{
+			return ColorF(a.r - b.r, a.g - b.g, a.b - b.b, a.a);
+		}
+
+		template<class A, class B>
+		auto Multiply(const A& a, const B& b) -> decltype(a*b)
+		{
+			return a*b;
+		}
+
+		inline ColorF Multiply(const ColorF& a, const ColorF& b)
+		{
+			return ColorF(a.r*b.r, a.g*b.g, a.b*b.b, a.a);
+		}
+
+		template<class A>
+		A Maximum(const A& a, const A& b)
+		{
+			return Max(a, b);
+		}
+
+		inline ColorF Maximum(const ColorF& a, const ColorF& b)
+		{
+			return ColorF(Max(a.r, b.r), Max(a.g, b.g), Max(a.b, b.b), a.a);
+		}
+
+		template<class A>
+		A Minimum(const A& a, const A& b)
+		{
+			return Min(a, b);
+		}
+
+		inline ColorF Minimum(const ColorF& a, const ColorF& b)
+		{
+			return ColorF(Min(a.r, b.r), Min(a.g, b.g), Min(a.b, b.b), a.a);
+		}
+
+		struct AddOp
+		{
+			template<class A, class B>
+			auto operator()(const A& a, const B& b)const -> decltype(Add(a, b))
+			{
+				return Add(a, b);
+			}
+		};
+
+		struct SubtractOp
+		{
+			template<class A, class B>
+			auto operator()(const A& a, const B& b)const -> decltype(Subtract(a, b))
+			{
+				return Subtract(a, b);
+			}
+		};
+
+		struct MultiplyOp
+		{
+			template<class A, class B>
+			auto operator()(const A& a, const B& b)const -> decltype(Multiply(a, b))
+			{
+				return Multiply(a, b);
+			}
+		};
+
+		//スカラーを左に置いた掛け算は、左右を入れ替えてColorF * doubleなどに合わせる
+		//Multiplication with the scalar on the left swaps sides to match ColorF * double and so on.
+		struct ReversedMultiplyOp
+		{
+			template<class A, class B>
+			auto operator()(const A& a, const B& b)const -> decltype(Multiply(b, a))
+			{
+				return Multiply(b, a);
+			}
+		};
+
+		struct MaximumOp
+		{
+			template<class A, class B>
+			auto operator()(const A& a, const B& b)const -> decltype(Maximum(a, b))
+			{
+				return Maximum(a, b);
+			}
+		};
+
+		struct MinimumOp
+		{
+			template<class A, class B>
+			auto operator()(const A& a, const B& b)const -> decltype(Minimum(a, b))
+			{
+				return Minimum(a, b);
+			}
+		};
+
+		template<class Op, class L, class R>
+		class BinaryExpression : public GridExpression<BinaryExpression<Op, L, R>>
+		{
+		public:
+
+			BinaryExpression(const L& left, const R& right)
+				: m_left(left)
+				, m_right(right) {}
+
+			auto operator()(size_t i)const -> decltype(Op()(std::declval<const L&>()(i), std::declval<const R&>()(i)))
+			{
+				return Op()(m_left(i), m_right(i));
+			}
+
+			size_t width()const
+			{
+				return CommonExtent(m_left.width(), m_right.width());
+			}
+
+			size_t height()const
+			{
+				return CommonExtent(m_left.height(), m_right.height());
+			}
+
+		private:
+
+			L m_left;
+			R m_right;
+		};
+
+		template<class M, class A, class B>
+		class SelectExpression : public GridExpression<SelectExpression<M, A, B>>
+		{
+		public:
+
+			using value_type = typename std::decay<decltype(std::declval<const A&>()(0))>::type;
+
+			SelectExpression(const M& mask, const A& a, const B& b)
+				: m_mask(mask)
+				, m_a(a)
+				, m_b(b) {}
+
+			value_type operator()(size_t i)const
+			{
+				return m_mask(i) ? value_type(m_a(i)) : value_type(m_b(i));
+			}
+
+			size_t width()const
+			{
+				return CommonExtent(m_mask.width(), CommonExtent(m_a.width(), m_b.width()));
+			}
+
+			size_t height()const
+			{
+				return CommonExtent(m_mask.height(), CommonExtent(m_a.height(), m_b.height()));
+			}
+
+		private:
+
+			M m_mask;
+			A m_a;
+			B m_b;
+		};
+
+		template<class Op, class A, class B>
+		BinaryExpression<Op, OperandType<A>, OperandType<B>> MakeBinary(const A& a, const B& b)
+		{
+			return BinaryExpression<Op, OperandType<A>, OperandType<B>>(AsOperand(a), AsOperand(b));
+		}
+	}
+
+	template<class A, class B, class = detail::EnableIfGridOperands<A, B>>
+	auto operator+(const A& a, const B& b) -> decltype(detail::MakeBinary<detail::AddOp>(a, b))
+	{
+		return detail::MakeBinary<detail::AddOp>(a, b);
+	}
+
+	template<class A, class B, class = detail::EnableIfGridOperands<A, B>>
+	auto operator-(const A& a, const B& b) -> decltype(detail::MakeBinary<detail::SubtractOp>(a, b))
+	{
+		return detail::MakeBinary<detail::SubtractOp>(a, b);
+	}
+
+	template<class A, class B, class = detail::EnableIfGridOperands<A, B>, class = typename std::enable_if<detail::IsGridLike<A>::value>::type>
+	auto operator*(const A& a, const B& b) -> decltype(detail::MakeBinary<detail::MultiplyOp>(a, b))
+	{
+		return detail::MakeBinary<detail::MultiplyOp>(a, b);
+	}
+
+	template<class A, class B, class = typename std::enable_if<!detail::IsGridLike<A>::value && detail::IsGridLike<B>::value>::type>
+	auto operator*(const A& a, const B& b) -> decltype(detail::MakeBinary<detail::ReversedMultiplyOp>(a, b))
+	{
+		return detail::MakeBinary<detail::ReversedMultiplyOp>(a, b);
+	}
+
+	//セルごとの大きい方。ColorFはチャンネルごと
+	//Per-cell larger value. Per channel for ColorF.
+	template<class A, class B, class = detail::EnableIfGridOperands<A, B>>
+	auto Maximum(const A& a, const B& b) -> decltype(detail::MakeBinary<detail::MaximumOp>(a, b))
+	{
+		return detail::MakeBinary<detail::MaximumOp>(a, b);
+	}
+
+	template<class A, class B, class = detail::EnableIfGridOperands<A, B>>
+	auto Minimum(const A& a, const B& b) -> decltype(detail::MakeBinary<detail::MinimumOp>(a, b))
+	{
+		return detail::MakeBinary<detail::MinimumOp>(a, b);
+	}
+
+	//maskのセルが真ならa、偽ならbを選ぶ。結果の型はaのセルの型
+	//Selects a where the cell of mask is true and b where it is false. The result has the cell type of a.
+	template<class M, class A, class B>
+	detail::SelectExpression<detail::OperandType<M>, detail::OperandType<A>, detail::OperandType<B>> Select(const M& mask, const A& a, const B& b)
+	{
+		return detail::SelectExpression<detail::OperandType<M>, detail::OperandType<A>, detail::OperandType<B>>(detail::AsOperand(mask), detail::AsOperand(a), detail::AsOperand(b));
+	}
+
+	//式をdestinationに1回の走査で書き込む。destinationが式と違う大きさなら合わせる
+	//regionを渡すと、その中のセルだけを書き込む（destinationは式と同じ大きさであること）
+	//Writes the expression into destination in a single pass. destination is resized if it differs from the expression.
+	//Given a region, only cells inside it are written (destination must have the same size as the expression).
+	template<class Policy, class T, class Derived>
+	void Assign(const Policy& policy, Grid2D<T>& destination, const GridExpression<Derived>& expression)
+	{
+		const Derived& e = expression.derived();
+		if (destination.width() != e.width() || destination.height() != e.height())
+		{
+			destination.resize(e.width(), e.height());
+		}
+
+		T* cells = destination.data();
+		const size_t numChunks = detail::RangeChunkCount(policy, e.width(), e.height(), detail::WholeGrid());
+		detail::ForEachRange(policy, e.width(), e.height(), detail::WholeGrid(), numChunks, [&](size_t, size_t begin, size_t end)
+		{
+			auto body = [&](size_t i)
+			{
+				cells[i] = T(e(i));
+			};
+			detail::Loop(policy, begin, end, body);
+		});
+	}
+
+	template<class Policy, class T, class Region, class Derived>
+	void Assign(const Policy& policy, Grid2D<T>& destination, const Region& region, const GridExpression<Derived>& expression)
+	{
+		const Derived& e = expression.derived();
+		assert(destination.width() == e.width() && destination.height() == e.height());
+
+		T* cells = destination.data();
+		const size_t numChunks = detail::RangeChunkCount(policy, e.width(), e.height(), region);
+		detail::ForEachRange(policy, e.width(), e.height(), region, numChunks, [&](size_t, size_t begin, size_t end)
+		{
+			auto body = [&](size_t i)
+			{
+				cells[i] = T(e(i));
+			};
+			detail::Loop(policy, begin, end, body);
+		});
+	}
+
+	template<class Derived>
+	template<class T>
+	void GridExpression<Derived>::evaluateTo(Grid2D<T>& destination)const
+	{
+		Assign(execution::par_unseq, destination, *this);
+	}
+}
@@ -0,0 +1,107 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <array>
+#include "Geometry.hpp"
+
+namespace lighting
+{
+	//フィールドが読むボタン
+	//Buttons read by the field.
+	enum class InputButton
+	{
+		//押している間、カーソルのセルを壁にする
+		//While pressed, the cell under the cursor becomes a wall.
+		PlaceWall,
+
+		//押している間、カーソルのセルを空間にする
+		//While pressed, the cell under the cursor becomes space.
+		RemoveWall,
+
+		//押している間、ライトがカーソルから逃げる。AttractLightsも押していれば逆に引き寄せられる
+		//While pressed, lights flee from the cursor. They are pulled towards it instead if AttractLights is also pressed.
+		DriveLights,
+
+		AttractLights,
+	};
+
+	//フィールドへの入力。アプリ側でSiv3Dなどの入力をこの形に変換して渡す
+	//Input to the field. The application converts the input of Siv3D or others into this form.
+	class InputSource
+	{
+	public:
+
+		virtual ~InputSource() = default;
+
+		//カーソルの位置[px]
+		//Position of the cursor [px].
+		virtual Vec2 cursorPos()const = 0;
+
+		virtual bool isPressed(InputButton button)const = 0;
+	};
+
+	//何も押されていない入力。ヘッドレスで動かすときに使う
+	//Input with nothing pressed. Used when running headless.
+	class NullInput : public InputSource
+	{
+	public:
+
+		Vec2 cursorPos()const override
+		{
+			return Vec2(-1.0, -1.0);
+		}
+
+		bool isPressed(InputButton)const override
+		{
+			return false;
+		}
+	};
+
+	//ある時点の入力の写し。別のスレッドで後から読むために使う
+	//A copy of input at some point in time. Used to read it later on another thread.
+	class InputSnapshot : public InputSource
+	{
+	public:
+
+		InputSnapshot() = default;
+
+		explicit InputSnapshot(const InputSource& input)
+			: m_cursorPos(input.cursorPos())
+		{
+			for (size_t i = 0; i < m_pressed.size(); ++i)
+			{
+				m_pressed[i] = input.isPressed(static_cast<InputButton>(i));
+			}
+		}
+
+		Vec2 cursorPos()const override
+		{
+			return m_cursorPos;
+		}
+
+		bool isPressed(InputButton button)const override
+		{
+			return m_pressed[static_cast<size_t>(button)];
+		}
+
+		//壁を書き換える入力かどうか
+		//Whether the input rewrites walls.
+		bool editsWalls()const
+		{
+			return isPressed(InputButton::PlaceWall) || isPressed(InputButton::RemoveWall);
+		}
+
+	private:
+
+		Vec2 m_cursorPos = Vec2(-1.0, -1.0);
+
+		std::array<bool, static_cast<size_t>(InputButton::AttractLights) + 1> m_pressed = {};
+	};
+}
@@ -0,0 +1,97 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <cmath>
+#include <vector>
+#include "Geometry.hpp"
+#include "Grid2D.hpp"
+#include "GridAlgorithm.hpp"
+
+namespace lighting
+{
+	//壁のない場所での1つのライトの明るさの模様。8近傍の減衰を最短の経路（斜めに進んでから縦横に進む）で掛けたもの
+	//届く距離ごとに一度だけ作り、届く範囲に壁がないライトは伝播させずに格子へ最大値で書き込む
+	//Brightness pattern of a single light without walls: 8-neighbor attenuation multiplied along the shortest path (diagonal first, then straight).
+	//Built once per reach, and lights with no walls within reach are written to the grid by maximum instead of being propagated.
+	class LightStamp
+	{
+	public:
+
+		LightStamp(double attenuationAdjacent, double attenuationDiagonal)
+			: m_adjacent(attenuationAdjacent)
+			, m_diagonal(attenuationDiagonal) {}
+
+		//centerからrange以内（CellRegion::addDiscと同じ円）の各セルを、colorに減衰を掛けた値との最大値にする。円は格子に収まっていること
+		//Raise each cell within range of center (the same disc as CellRegion::addDisc) to color times attenuation. The disc must fit in the grid.
+		void apply(Grid2D<ColorF>& brightness, const Point& center, double range, const ColorF& color)
+		{
+			const int reach = Max(static_cast<int>(Ceil(range)), 0);
+			const auto& table = stamp(reach);
+			const size_t side = 2 * reach + 1;
+
+			for (int dy = -reach; dy <= reach; ++dy)
+			{
+				const double half = range*range - dy*dy;
+				if (half < 0.0)
+				{
+					continue;
+				}
+
+				const int halfWidth = static_cast<int>(Sqrt(half));
+				ColorF* const cells = brightness[center.y + dy].data() + center.x - halfWidth;
+				const double* const factors = table.data() + (dy + reach)*side + reach - halfWidth;
+				const int width = 2 * halfWidth + 1;
+
+				LIGHTING_INDEPENDENT_LOOP
+				for (int x = 0; x < width; ++x)
+				{
+					cells[x].r = Max(cells[x].r, color.r*factors[x]);
+					cells[x].g = Max(cells[x].g, color.g*factors[x]);
+					cells[x].b = Max(cells[x].b, color.b*factors[x]);
+				}
+			}
+		}
+
+	private:
+
+		//(2*reach+1)^2の減衰の表。中心が(reach, reach)
+		//Table of (2*reach+1)^2 attenuation factors centred at (reach, reach).
+		const std::vector<double>& stamp(int reach)
+		{
+			if (m_stamps.size() <= static_cast<size_t>(reach))
+			{
+				m_stamps.resize(reach + 1);
+			}
+
+			auto& table = m_stamps[reach];
+			if (!table.empty())
+			{
+				return table;
+			}
+
+			const int side = 2 * reach + 1;
+			table.resize(static_cast<size_t>(side)*side);
+			for (int dy = -reach; dy <= reach; ++dy)
+			{
+				for (int dx = -reach; dx <= reach; ++dx)
+				{
+					const int diagonalSteps = Min(Abs(dx), Abs(dy));
+					const int straightSteps = Max(Abs(dx), Abs(dy)) - diagonalSteps;
+					table[(dy + reach)*side + dx + reach] = std::pow(m_diagonal, diagonalSteps)*std::pow(m_adjacent, straightSteps);
+				}
+			}
+			return table;
+		}
+
+		double m_adjacent;
+		double m_diagonal;
+		std::vector<std::vector<double>> m_stamps;
+	};
+}
@@ -0,0 +1,305 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#include <memory>
+#include <new>
+#include "LightingC.h"
+#include "Field.hpp"
+
+struct LightingField
+{
+	LightingField(const lighting::Size& fieldSize, int gridUnitPixel)
+		: field(fieldSize, gridUnitPixel) {}
+
+	lighting::Field field;
+
+	//lighting_field_acquire_brightnessの入れ子の深さ
+	//Nesting depth of lighting_field_acquire_brightness.
+	int numAcquired = 0;
+
+	//lighting_field_set_schedulerで渡されたスケジューラ
+	//Scheduler given by lighting_field_set_scheduler.
+	std::unique_ptr<lighting::HostExecutor> executor;
+};
+
+namespace
+{
+	static_assert(sizeof(lighting::ColorF) == 4 * sizeof(double), "ColorF must be four packed doubles to expose it as planes.");
+
+	lighting::LightHandle ToHandle(const LightingLight& light)
+	{
+		lighting::LightHandle handle;
+		handle.slot = light.slot;
+		handle.generation = light.generation;
+		return handle;
+	}
+
+	void RunTask(void* task)
+	{
+		const std::unique_ptr<std::function<void()>> func(static_cast<std::function<void()>*>(task));
+		(*func)();
+	}
+
+	//C++の例外をCの境界の外に出さない。コアを呼ぶ関数はすべてこれを通す
+	//Keeps C++ exceptions from crossing the C boundary. Every function calling into the core goes through this.
+	template<class Func>
+	LightingResult Guard(const Func& func)
+	{
+		try
+		{
+			return func();
+		}
+		catch (const std::bad_alloc&)
+		{
+			return LIGHTING_ERROR_OUT_OF_MEMORY;
+		}
+		catch (...)
+		{
+			return LIGHTING_ERROR_INTERNAL;
+		}
+	}
+}
+
+extern "C"
+{
+	LightingField* lighting_field_create(int fieldWidth, int fieldHeight, int gridUnitPixel)
+	{
+		if (gridUnitPixel <= 0 || fieldWidth < gridUnitPixel || fieldHeight < gridUnitPixel
+			|| fieldWidth % gridUnitPixel != 0 || fieldHeight % gridUnitPixel != 0)
+		{
+			return nullptr;
+		}
+
+		try
+		{
+			LightingField* field = new LightingField(lighting::Size(fieldWidth, fieldHeight), gridUnitPixel);
+			field->field.clearLights();
+			return field;
+		}
+		catch (...)
+		{
+			return nullptr;
+		}
+	}
+
+	void lighting_field_destroy(LightingField* field)
+	{
+		delete field;
+	}
+
+	LightingResult lighting_field_grid_size(const LightingField* field, int* width, int* height)
+	{
+		if (!field || !width || !height)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			const lighting::Size size = field->field.gridSize();
+			*width = size.x;
+			*height = size.y;
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_set_walls(LightingField* field, int x, int y, int width, int height, const uint8_t* cells, size_t stride)
+	{
+		if (!field || (!cells && 0 < width && 0 < height) || width < 0 || height < 0)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			const lighting::Size size = field->field.gridSize();
+			if (x < 0 || y < 0 || size.x - width < x || size.y - height < y)
+			{
+				return LIGHTING_ERROR_INVALID_ARGUMENT;
+			}
+
+			auto edit = field->field.editWalls();
+			for (int j = 0; j < height; ++j)
+			{
+				const uint8_t* row = cells + j*stride;
+				for (int i = 0; i < width; ++i)
+				{
+					edit.set({ x + i, y + j }, row[i] ? lighting::Field::FieldWall() : lighting::Field::FieldSpace());
+				}
+			}
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_add_light(LightingField* field, double x, double y, double r, double g, double b, double intensity, double range, LightingLight* light)
+	{
+		if (!field || !light)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			const lighting::LightHandle handle = field->field.addLight(lighting::Vec2(x, y), lighting::ColorF(r, g, b), lighting::Vec2(0, 0), intensity, range);
+			light->slot = handle.slot;
+			light->generation = handle.generation;
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_remove_light(LightingField* field, LightingLight light)
+	{
+		if (!field)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			return field->field.removeLight(ToHandle(light)) ? LIGHTING_OK : LIGHTING_ERROR_INVALID_LIGHT;
+		});
+	}
+
+	LightingResult lighting_field_move_light(LightingField* field, LightingLight light, double x, double y)
+	{
+		if (!field)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			if (!field->field.isAlive(ToHandle(light)))
+			{
+				return LIGHTING_ERROR_INVALID_LIGHT;
+			}
+
+			field->field.setLightPos(ToHandle(light), lighting::Vec2(x, y));
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_set_light_color(LightingField* field, LightingLight light, double r, double g, double b, double intensity)
+	{
+		if (!field)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			if (!field->field.isAlive(ToHandle(light)))
+			{
+				return LIGHTING_ERROR_INVALID_LIGHT;
+			}
+
+			field->field.setLightColor(ToHandle(light), lighting::ColorF(r, g, b));
+			field->field.setLightIntensity(ToHandle(light), intensity);
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_set_light_range(LightingField* field, LightingLight light, double range)
+	{
+		if (!field)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			if (!field->field.isAlive(ToHandle(light)))
+			{
+				return LIGHTING_ERROR_INVALID_LIGHT;
+			}
+
+			field->field.setLightRange(ToHandle(light), range);
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_set_scheduler(LightingField* field, LightingScheduleFunction schedule, void* userData, int concurrency)
+	{
+		if (!field || (schedule && concurrency <= 0))
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			if (!schedule)
+			{
+				field->field.setExecutor(lighting::DefaultExecutor());
+				field->executor.reset();
+				return LIGHTING_OK;
+			}
+
+			field->executor.reset(new lighting::HostExecutor([schedule, userData](std::function<void()> task)
+			{
+				schedule(RunTask, new std::function<void()>(std::move(task)), userData);
+			}, static_cast<size_t>(concurrency)));
+			field->field.setExecutor(*field->executor);
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_step(LightingField* field)
+	{
+		if (!field)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		if (0 < field->numAcquired)
+		{
+			return LIGHTING_ERROR_BRIGHTNESS_ACQUIRED;
+		}
+
+		return Guard([&]
+		{
+			field->field.updateLighting();
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_acquire_brightness(LightingField* field, LightingBrightness* brightness)
+	{
+		if (!field || !brightness)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		return Guard([&]
+		{
+			const auto& grid = field->field.brightnessGrid();
+			const double* cells = reinterpret_cast<const double*>(grid.data());
+			brightness->r = cells;
+			brightness->g = cells + 1;
+			brightness->b = cells + 2;
+			brightness->width = static_cast<int>(grid.width());
+			brightness->height = static_cast<int>(grid.height());
+			brightness->cellStride = sizeof(lighting::ColorF) / sizeof(double);
+			brightness->rowStride = grid.width()*brightness->cellStride;
+
+			++field->numAcquired;
+			return LIGHTING_OK;
+		});
+	}
+
+	LightingResult lighting_field_release_brightness(LightingField* field)
+	{
+		if (!field || field->numAcquired <= 0)
+		{
+			return LIGHTING_ERROR_INVALID_ARGUMENT;
+		}
+
+		--field->numAcquired;
+		return LIGHTING_OK;
+	}
+}
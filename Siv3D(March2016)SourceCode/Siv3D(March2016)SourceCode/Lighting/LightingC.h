@@ -0,0 +1,159 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#ifndef LIGHTING_C_H
+#define LIGHTING_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//他の言語やエンジンからフィールドを動かすためのC API
+//
+//所有権:
+//  lighting_field_createが返したフィールドは呼び出し側が所有し、lighting_field_destroyで解放する
+//  lighting_field_acquire_brightnessが返すポインタはフィールドが所有する。コピーせずにそのまま読める
+//  ポインタはlighting_field_release_brightnessを呼ぶか、フィールドを解放するまで有効
+//
+//スレッド:
+//  1つのフィールドへの呼び出しは同時に行わないこと（呼び出し側で直列化する）
+//  別々のフィールドは別々のスレッドから同時に使ってよい
+//  明るさの読み取り中（acquireからreleaseまで）は、lighting_field_stepはLIGHTING_ERROR_BRIGHTNESS_ACQUIREDを返して何もしない
+//  そのため、読み取りを別のスレッドで行う場合も、stepの前にreleaseすれば同期は要らない
+//
+//C API for driving the field from other languages and engines.
+//
+//Ownership:
+//  A field returned by lighting_field_create is owned by the caller and released with lighting_field_destroy.
+//  Pointers returned by lighting_field_acquire_brightness are owned by the field. They can be read directly without copying.
+//  The pointers stay valid until lighting_field_release_brightness is called or the field is destroyed.
+//
+//Threading:
+//  Do not call into one field concurrently (the caller serializes the calls).
+//  Separate fields may be used from separate threads at the same time.
+//  While brightness is acquired (from acquire to release), lighting_field_step returns LIGHTING_ERROR_BRIGHTNESS_ACQUIRED and does nothing.
+//  So even when reading on another thread, no further synchronization is needed as long as release happens before step.
+
+#if defined(_WIN32)
+#	if defined(LIGHTING_C_BUILD)
+#		define LIGHTING_API __declspec(dllexport)
+#	else
+#		define LIGHTING_API __declspec(dllimport)
+#	endif
+#else
+#	define LIGHTING_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct LightingField LightingField;
+
+typedef enum LightingResult
+{
+	LIGHTING_OK = 0,
+	LIGHTING_ERROR_INVALID_ARGUMENT = 1,
+
+	//削除済みのライトを指すハンドル
+	//Handle referring to a removed light.
+	LIGHTING_ERROR_INVALID_LIGHT = 2,
+
+	LIGHTING_ERROR_BRIGHTNESS_ACQUIRED = 3,
+	LIGHTING_ERROR_OUT_OF_MEMORY = 4,
+
+	//メモリ不足以外の内部のエラー（スレッドを起動できなかったときなど）
+	//Internal error other than running out of memory (such as failing to start a thread).
+	LIGHTING_ERROR_INTERNAL = 5
+} LightingResult;
+
+//ライトを指すハンドル。generationが0なら無効
+//Handle referring to a light. A generation of 0 means invalid.
+typedef struct LightingLight
+{
+	uint32_t slot;
+	uint32_t generation;
+} LightingLight;
+
+//明るさの読み取り専用の参照
+//各チャンネルは別々の平面として見える。セル(x, y)の赤はr[y*rowStride + x*cellStride]
+//ストライドはdouble単位。実際にはr, g, bは同じ配列に交互に並んでいて、コピーはしていない
+//Read-only view of brightness.
+//Each channel appears as a separate plane. Red of cell (x, y) is r[y*rowStride + x*cellStride].
+//Strides are in doubles. In fact r, g and b are interleaved in the same array and nothing is copied.
+typedef struct LightingBrightness
+{
+	const double* r;
+	const double* g;
+	const double* b;
+	int width;
+	int height;
+	size_t cellStride;
+	size_t rowStride;
+} LightingBrightness;
+
+//ホストのスケジューラに渡すタスク。runにtaskを渡して、いずれかのスレッドでちょうど一度呼ぶこと
+//Task handed to the scheduler of the host. Call run with task exactly once on some thread.
+typedef void (*LightingTaskFunction)(void* task);
+typedef void (*LightingScheduleFunction)(LightingTaskFunction run, void* task, void* userData);
+
+//fieldWidth, fieldHeight[px]はgridUnitPixelで割り切れること。失敗したらNULLを返す
+//ライトはなく、外周は壁になっている
+//fieldWidth and fieldHeight [px] must be divisible by gridUnitPixel. Returns NULL on failure.
+//There are no lights, and the border is walls.
+LIGHTING_API LightingField* lighting_field_create(int fieldWidth, int fieldHeight, int gridUnitPixel);
+
+//NULLなら何もしない
+//Does nothing for NULL.
+LIGHTING_API void lighting_field_destroy(LightingField* field);
+
+//格子のセルの数
+//Number of cells of the grid.
+LIGHTING_API LightingResult lighting_field_grid_size(const LightingField* field, int* width, int* height);
+
+//セル[x, x + width) × [y, y + height)の壁をまとめて設定する。cells[j*stride + i]が0でなければセル(x + i, y + j)は壁
+//範囲は格子の中に収まること
+//Sets walls of cells [x, x + width) x [y, y + height) at once. Cell (x + i, y + j) is a wall if cells[j*stride + i] is not 0.
+//The range must lie inside the grid.
+LIGHTING_API LightingResult lighting_field_set_walls(LightingField* field, int x, int y, int width, int height, const uint8_t* cells, size_t stride);
+
+//位置は[px]、rangeは光が届く半径[セル]
+//Position is in [px], and range is the radius [cells] the light reaches.
+LIGHTING_API LightingResult lighting_field_add_light(LightingField* field, double x, double y, double r, double g, double b, double intensity, double range, LightingLight* light);
+
+LIGHTING_API LightingResult lighting_field_remove_light(LightingField* field, LightingLight light);
+
+LIGHTING_API LightingResult lighting_field_move_light(LightingField* field, LightingLight light, double x, double y);
+
+LIGHTING_API LightingResult lighting_field_set_light_color(LightingField* field, LightingLight light, double r, double g, double b, double intensity);
+
+LIGHTING_API LightingResult lighting_field_set_light_range(LightingField* field, LightingLight light, double range);
+
+//光の計算の並列処理をホストのスケジューラで実行する。concurrencyはホストが割けるスレッドの数
+//stepはタスクの完了を待ってから戻るが、仕事の残っていないタスクがその後に実行されることがある
+//scheduleがNULLなら、ライブラリのスレッドプールに戻す
+//Runs parallel work of light computation on the scheduler of the host. concurrency is the number of threads the host can spare.
+//step waits for its tasks to complete before returning, but tasks with no work left may run after it.
+//If schedule is NULL, the thread pool of the library is used again.
+LIGHTING_API LightingResult lighting_field_set_scheduler(LightingField* field, LightingScheduleFunction schedule, void* userData, int concurrency);
+
+//現在の壁とライトで光を計算し直す。ライトは動かさない
+//Recomputes light with the current walls and lights. Lights are not moved.
+LIGHTING_API LightingResult lighting_field_step(LightingField* field);
+
+//最後のstepの明るさを参照する。releaseするまで次のstepはできない。入れ子にしてよい
+//Refers to the brightness of the last step. The next step is not possible until released. May be nested.
+LIGHTING_API LightingResult lighting_field_acquire_brightness(LightingField* field, LightingBrightness* brightness);
+
+LIGHTING_API LightingResult lighting_field_release_brightness(LightingField* field);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,293 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Geometry.hpp"
+
+namespace lighting
+{
+	//タスクを実行する先。光の計算の並列処理はすべてこれを通す
+	//既定ではDefaultExecutorのスレッドプールを使う。ホストが自前のジョブシステムを持つ場合はHostExecutorで渡すと、コアを取り合わずに済む
+	//Where tasks are run. All parallel work of light computation goes through it.
+	//By default the thread pool of DefaultExecutor is used. A host with its own job system can pass it through HostExecutor so that they do not compete for cores.
+	class Executor
+	{
+	public:
+
+		virtual ~Executor() = default;
+
+		//同時に実行できるタスクの数の目安
+		//Approximate number of tasks that can run at the same time.
+		virtual size_t concurrency()const = 0;
+
+		//タスクを非同期に実行する。タスクは例外を投げないこと
+		//Runs a task asynchronously. The task must not throw.
+		void submit(std::function<void()> task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				++m_numPending;
+			}
+
+			schedule([this, task]
+			{
+				task();
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_numPending == 0)
+				{
+					m_idle.notify_all();
+				}
+			});
+		}
+
+		//submitしたタスクがすべて終わるまで待つ。タスクの中から呼ばないこと
+		//Waits until all submitted tasks finish. Do not call it from inside a task.
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_idle.wait(lock, [this] { return m_numPending == 0; });
+		}
+
+		//[0, count) をnumChunks個の連続区間に分けて並列に処理する
+		//func(chunkIndex, begin, end) はチャンクごとに一度だけ呼ばれる
+		//呼び出したスレッドも残りのチャンクを取って処理するので、タスクの中から呼んでも止まらない
+		//Process [0, count) in parallel split into numChunks contiguous ranges.
+		//func(chunkIndex, begin, end) is called once per chunk.
+		//The calling thread also takes remaining chunks, so it does not stall when called from inside a task.
+		template<class Func>
+		void parallelForChunks(size_t count, size_t numChunks, const Func& func)
+		{
+			if (numChunks <= 1 || count <= 1)
+			{
+				func(size_t(0), size_t(0), count);
+				return;
+			}
+
+			//遅れて始まった手伝いのタスクが参照するので、共有の状態はこの関数より長く生かす
+			//Helper tasks starting late still refer to it, so the shared state outlives this function.
+			struct Chunks
+			{
+				std::atomic<size_t> next{ 0 };
+				std::atomic<size_t> numDone{ 0 };
+				std::mutex mutex;
+				std::condition_variable done;
+			};
+			const auto chunks = std::make_shared<Chunks>();
+
+			const auto runChunks = [count, numChunks](Chunks& state, const Func& f)
+			{
+				for (size_t chunk = state.next++; chunk < numChunks; chunk = state.next++)
+				{
+					f(chunk, count*chunk / numChunks, count*(chunk + 1) / numChunks);
+					if (++state.numDone == numChunks)
+					{
+						std::lock_guard<std::mutex> lock(state.mutex);
+						state.done.notify_all();
+					}
+				}
+			};
+
+			const size_t numHelpers = Min(numChunks, Max<size_t>(concurrency(), 1u)) - 1;
+			const Func* pFunc = &func;
+			for (size_t i = 0; i < numHelpers; ++i)
+			{
+				//funcはチャンクを取れたときだけ使う。取れたチャンクが終わるまでこの関数は戻らない
+				//func is used only after taking a chunk. This function does not return until taken chunks finish.
+				schedule([chunks, runChunks, pFunc]
+				{
+					runChunks(*chunks, *pFunc);
+				});
+			}
+
+			runChunks(*chunks, func);
+
+			std::unique_lock<std::mutex> lock(chunks->mutex);
+			chunks->done.wait(lock, [&] { return chunks->numDone == numChunks; });
+		}
+
+		//少ない要素数でタスクに分けても割に合わないので、チャンクあたりminChunkSize個以上にする
+		//Splitting few elements into tasks does not pay off, so keep at least minChunkSize elements per chunk.
+		size_t chunkCount(size_t count, size_t minChunkSize = 1024)const
+		{
+			return Max<size_t>(Min(Max<size_t>(concurrency(), 1u), count / Max<size_t>(minChunkSize, 1u)), 1u);
+		}
+
+		template<class Func>
+		void parallelFor(size_t count, const Func& func, size_t minChunkSize = 1024)
+		{
+			parallelForChunks(count, chunkCount(count, minChunkSize), [&func](size_t, size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					func(i);
+				}
+			});
+		}
+
+	protected:
+
+		//taskをいずれかのスレッドで一度だけ実行する
+		//Runs task exactly once on some thread.
+		virtual void schedule(std::function<void()> task) = 0;
+
+	private:
+
+		std::mutex m_mutex;
+		std::condition_variable m_idle;
+		size_t m_numPending = 0;
+	};
+
+	//固定数のワーカーを持つスレッドプール
+	//Thread pool with a fixed number of workers.
+	class ThreadPool : public Executor
+	{
+	public:
+
+		explicit ThreadPool(size_t numWorkers = Max<size_t>(std::thread::hardware_concurrency(), 1u))
+		{
+			for (size_t i = 0; i < Max<size_t>(numWorkers, 1u); ++i)
+			{
+				m_workers.emplace_back([this] { work(); });
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		//キューに残ったタスクを実行し終えてからワーカーを止める
+		//Stops workers after running the tasks left in the queue.
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+			m_ready.notify_all();
+
+			for (auto& worker : m_workers)
+			{
+				worker.join();
+			}
+		}
+
+		size_t concurrency()const override
+		{
+			return m_workers.size();
+		}
+
+	protected:
+
+		void schedule(std::function<void()> task) override
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(std::move(task));
+			}
+			m_ready.notify_one();
+		}
+
+	private:
+
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (;;)
+			{
+				m_ready.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+				if (m_queue.empty())
+				{
+					return;
+				}
+
+				std::function<void()> task = std::move(m_queue.front());
+				m_queue.pop_front();
+
+				lock.unlock();
+				task();
+				lock.lock();
+			}
+		}
+
+		std::mutex m_mutex;
+		std::condition_variable m_ready;
+		std::deque<std::function<void()>> m_queue;
+		bool m_stopping = false;
+		std::vector<std::thread> m_workers;
+	};
+
+	//ホストのスケジューラにタスクを渡す
+	//scheduleは受け取ったタスクをいずれかのスレッドで一度だけ実行すること。concurrencyはホストが光の計算に割けるスレッドの数
+	//Hands tasks to the scheduler of the host.
+	//schedule must run each task it receives exactly once on some thread. concurrency is the number of threads the host can spare for light computation.
+	class HostExecutor : public Executor
+	{
+	public:
+
+		using ScheduleFunction = std::function<void(std::function<void()> task)>;
+
+		HostExecutor(ScheduleFunction schedule, size_t concurrency)
+			: m_schedule(std::move(schedule))
+			, m_concurrency(Max<size_t>(concurrency, 1u)) {}
+
+		size_t concurrency()const override
+		{
+			return m_concurrency;
+		}
+
+	protected:
+
+		void schedule(std::function<void()> task) override
+		{
+			m_schedule(std::move(task));
+		}
+
+	private:
+
+		ScheduleFunction m_schedule;
+		size_t m_concurrency;
+	};
+
+	//タスクを呼び出したスレッドでその場で実行する。スレッドを一切使わない
+	//Runs tasks on the calling thread immediately. Uses no threads at all.
+	class InlineExecutor : public Executor
+	{
+	public:
+
+		size_t concurrency()const override
+		{
+			return 1;
+		}
+
+	protected:
+
+		void schedule(std::function<void()> task) override
+		{
+			task();
+		}
+	};
+
+	//ハードウェアのスレッド数のワーカーを持つ共有のプール。初めて使うときに作る
+	//プロセスの終了時やDLLの解放時にワーカーの終了を待たないよう、わざと破棄しない
+	//Shared pool with as many workers as hardware threads. Created on first use.
+	//Intentionally never destroyed, so that process exit or DLL unload does not wait for the workers to stop.
+	inline Executor& DefaultExecutor()
+	{
+		static ThreadPool* pool = new ThreadPool();
+		return *pool;
+	}
+}
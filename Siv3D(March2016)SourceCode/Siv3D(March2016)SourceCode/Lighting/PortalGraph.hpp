@@ -0,0 +1,804 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <vector>
+#include "Geometry.hpp"
+#include "Grid2D.hpp"
+
+namespace lighting
+{
+	//壁でないセルを部屋に分け、部屋どうしを出口でつないだグラフ
+	//縦か横に壁から壁までの幅がMaxDoorWidth以下のセルを入口や通路とみなし、それ以外のセルとは別に上下左右のつながりで部屋に分ける
+	//隣の部屋へ1歩で移れるセルの集まりを出口とし、同じ部屋の出口の間の最短の歩数を覚えておく
+	//出口の間の歩数は最も近いセルどうしのものなので、ライトから出口をたどって求めた歩数は本当の歩数より長くならない
+	//壁が変わったときは変化の周りの部屋だけを分け直し、出口の歩数もその部屋と隣の部屋だけで測り直す
+	//Graph splitting non-wall cells into rooms and connecting rooms through exits.
+	//Cells whose width from wall to wall, vertically or horizontally, is at most MaxDoorWidth are taken as doorways and corridors, and are split into rooms connected up, down, left and right apart from the other cells.
+	//The cells stepping into a neighbouring room in one step form an exit, and the fewest steps between exits of the same room are kept.
+	//Steps between exits are those of their closest cells, so steps found by following exits from a light never exceed the true steps.
+	//When walls change, only the rooms around the change are relabelled, and exits are measured again only for those rooms and the rooms next to them.
+	class PortalGraph
+	{
+	public:
+
+		static const int MaxDoorWidth = 4;
+
+		static const int NoRoom = -1;
+
+		void rebuild(const Grid2D<char>& walls, char wall)
+		{
+			markNarrowCells(walls, wall);
+			labelRooms(walls, wall);
+			buildExits();
+			measureExits();
+		}
+
+		//dirtyの中の壁が変わったときに呼ぶ
+		//狭さが変わりうるのはdirtyからMaxDoorWidth以内のセルだけなので、その周囲1セルまでにかかる部屋を塗り直す
+		//塗り直した部屋と、それに出口を持つ部屋の出口だけを作り直して測り、ほかの部屋の歩数の表はそのまま写す
+		//Called when walls inside dirty change.
+		//Only cells within MaxDoorWidth of dirty can change narrowness, so the rooms reaching into the 1-cell ring around them are refilled.
+		//Only the exits of refilled rooms and of rooms with exits into them are rebuilt and measured, and the step tables of other rooms are copied as they are.
+		void update(const Grid2D<char>& walls, char wall, const Rect& dirty)
+		{
+			if (m_roomOf.width() != walls.width() || m_roomOf.height() != walls.height())
+			{
+				rebuild(walls, wall);
+				return;
+			}
+
+			const Rect changed = clip(dirty);
+			if (changed.w <= 0 || changed.h <= 0)
+			{
+				return;
+			}
+
+			const Rect narrowArea = clip(Rect(changed.x - MaxDoorWidth, changed.y - MaxDoorWidth, changed.w + 2 * MaxDoorWidth, changed.h + 2 * MaxDoorWidth));
+			for (int y = narrowArea.y; y < narrowArea.y + narrowArea.h; ++y)
+			{
+				for (int x = narrowArea.x; x < narrowArea.x + narrowArea.w; ++x)
+				{
+					m_narrow[y][x] = isNarrow(walls, wall, Point(x, y));
+				}
+			}
+
+			clearRooms(walls, wall, changed, clip(Rect(narrowArea.x - 1, narrowArea.y - 1, narrowArea.w + 2, narrowArea.h + 2)));
+			refillRooms();
+			rebuildDirtyExits();
+			std::fill(m_roomDirty.begin(), m_roomDirty.end(), static_cast<char>(Clean));
+		}
+
+		//centerを中心とする半径radiusの円（CellRegion::addDiscと同じ円）のうち、centerからsteps歩以内に入れる部屋のセルを、func(y, begin, end) で行ごとに列挙する
+		//centerが壁のときは円をそのまま列挙する
+		//Enumerate per row with func(y, begin, end) the cells of the disc of radius around center (the same disc as CellRegion::addDisc) lying in rooms enterable within steps from center.
+		//When center is a wall, the whole disc is enumerated.
+		template<class Func>
+		void forEachReachSpan(const Point& center, double radius, int steps, Func func)
+		{
+			++m_stamp;
+			const bool confined = m_roomOf.isValid(center) && m_roomOf[center] != NoRoom;
+			if (confined)
+			{
+				findRooms(center, steps);
+			}
+
+			const int r = static_cast<int>(Ceil(radius));
+			for (int dy = -r; dy <= r; ++dy)
+			{
+				const int y = center.y + dy;
+				const double half = radius*radius - dy*dy;
+				if (half < 0.0 || y < 0 || static_cast<int>(m_roomOf.height()) <= y)
+				{
+					continue;
+				}
+
+				const int halfWidth = static_cast<int>(Sqrt(half));
+				const int beginX = Max(center.x - halfWidth, 0);
+				const int endX = Min(center.x + halfWidth + 1, static_cast<int>(m_roomOf.width()));
+				if (!confined)
+				{
+					if (beginX < endX)
+					{
+						func(y, beginX, endX);
+					}
+					continue;
+				}
+
+				const auto row = m_roomOf[y];
+				int runBegin = -1;
+				for (int x = beginX; x < endX; ++x)
+				{
+					const bool inside = row[x] != NoRoom && m_roomStamp[row[x]] == m_stamp;
+					if (inside && runBegin < 0)
+					{
+						runBegin = x;
+					}
+					else if (!inside && 0 <= runBegin)
+					{
+						func(y, runBegin, x);
+						runBegin = -1;
+					}
+				}
+				if (0 <= runBegin)
+				{
+					func(y, runBegin, endX);
+				}
+			}
+		}
+
+	private:
+
+		static const int Unlabelled = -2;
+
+		static const int Unreached = std::numeric_limits<int>::max();
+
+		//部屋の作り直しの印。Refilledは塗り直した部屋、Bordersはそれに出口を持つ部屋
+		//Marks of rooms being rebuilt. Refilled is a refilled room, and Borders is a room with exits into one.
+		enum RoomState : char
+		{
+			Clean,
+			Refilled,
+			Borders,
+		};
+
+		//roomの、targetへ移れるセルの集まり。peerはtargetの、roomへ移れる出口の添字
+		//Cells of room that step into target. peer is the index of the exit of target stepping into room.
+		struct Exit
+		{
+			int room;
+			int target;
+			int peer;
+			Rect bounds;
+		};
+
+		struct ExitCell
+		{
+			int room;
+			int target;
+			Point cell;
+		};
+
+		struct QueueEntry
+		{
+			int steps;
+			int exit;
+
+			bool operator>(const QueueEntry& other)const
+			{
+				return steps > other.steps;
+			}
+		};
+
+		static const std::array<Point, 8>& directions()
+		{
+			static const std::array<Point, 8> result =
+			{ {
+				Point(-1,-1),Point(+0,-1),Point(+1,-1),
+				Point(-1,+0),             Point(+1,+0),
+				Point(-1,+1),Point(+0,+1),Point(+1,+1)
+			} };
+			return result;
+		}
+
+		static bool isBefore(int roomA, int targetA, int roomB, int targetB)
+		{
+			return roomA != roomB ? roomA < roomB : targetA < targetB;
+		}
+
+		//縦横斜めに1歩ずつ進んでcellからrectへ着くまでの歩数（チェビシェフ距離）
+		//Steps from cell to rect moving one step at a time horizontally, vertically or diagonally (Chebyshev distance).
+		static int chebyshevDistance(const Point& cell, const Rect& rect)
+		{
+			const int dx = Max(Max(rect.x - cell.x, cell.x - (rect.x + rect.w - 1)), 0);
+			const int dy = Max(Max(rect.y - cell.y, cell.y - (rect.y + rect.h - 1)), 0);
+			return Max(dx, dy);
+		}
+
+		Rect clip(const Rect& rect)const
+		{
+			const int beginX = Max(rect.x, 0);
+			const int beginY = Max(rect.y, 0);
+			const int endX = Min(rect.x + rect.w, static_cast<int>(m_roomOf.width()));
+			const int endY = Min(rect.y + rect.h, static_cast<int>(m_roomOf.height()));
+			return Rect(beginX, beginY, Max(endX - beginX, 0), Max(endY - beginY, 0));
+		}
+
+		//両脇が壁の斜めには進めない
+		//A diagonal with walls on both sides cannot be passed.
+		bool canStep(const Point& from, const Point& direction)const
+		{
+			const Point to = from + direction;
+			if (!m_roomOf.isValid(to) || m_roomOf[to] == NoRoom)
+			{
+				return false;
+			}
+			return direction.x == 0 || direction.y == 0
+				|| m_roomOf[from.y][from.x + direction.x] != NoRoom || m_roomOf[from.y + direction.y][from.x] != NoRoom;
+		}
+
+		//横か縦の壁のない区間の長さがMaxDoorWidth以下のセルに印を付ける。格子の外は壁とみなす
+		//Mark cells whose wall-free run, horizontal or vertical, is at most MaxDoorWidth long. Outside the grid counts as wall.
+		void markNarrowCells(const Grid2D<char>& walls, char wall)
+		{
+			const int width = static_cast<int>(walls.width());
+			const int height = static_cast<int>(walls.height());
+			m_narrow.resize(walls.width(), walls.height());
+			m_narrow.reset(static_cast<char>(false));
+
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					int end = x;
+					while (end < width && walls[y][end] != wall)
+					{
+						++end;
+					}
+					for (int i = x; end - x <= MaxDoorWidth && i < end; ++i)
+					{
+						m_narrow[y][i] = true;
+					}
+					x = end;
+				}
+			}
+
+			for (int x = 0; x < width; ++x)
+			{
+				for (int y = 0; y < height; ++y)
+				{
+					int end = y;
+					while (end < height && walls[end][x] != wall)
+					{
+						++end;
+					}
+					for (int i = y; end - y <= MaxDoorWidth && i < end; ++i)
+					{
+						m_narrow[i][x] = true;
+					}
+					y = end;
+				}
+			}
+		}
+
+		//markNarrowCellsと同じ判定を1セルについて行う。壁から壁までをMaxDoorWidth + 1セル先まで調べる
+		//The same test as markNarrowCells for a single cell. Scans from wall to wall up to MaxDoorWidth + 1 cells away.
+		static bool isNarrow(const Grid2D<char>& walls, char wall, const Point& cell)
+		{
+			if (walls[cell] == wall)
+			{
+				return false;
+			}
+
+			for (const Point& axis : { Point(1, 0), Point(0, 1) })
+			{
+				int length = 1;
+				for (const int sign : { -1, 1 })
+				{
+					Point p = cell + Point(axis.x*sign, axis.y*sign);
+					while (length <= MaxDoorWidth && walls.isValid(p) && walls[p] != wall)
+					{
+						++length;
+						p = p + Point(axis.x*sign, axis.y*sign);
+					}
+				}
+
+				if (length <= MaxDoorWidth)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//狭さの同じセルどうしを上下左右のつながりで部屋に分ける
+		//Split cells of the same narrowness into rooms connected up, down, left and right.
+		void labelRooms(const Grid2D<char>& walls, char wall)
+		{
+			const int width = static_cast<int>(walls.width());
+			const int height = static_cast<int>(walls.height());
+			m_roomOf.resize(walls.width(), walls.height());
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					m_roomOf[y][x] = walls[y][x] == wall ? NoRoom : Unlabelled;
+				}
+			}
+
+			int room = 0;
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					if (m_roomOf[y][x] != Unlabelled)
+					{
+						continue;
+					}
+
+					fillRoom(Point(x, y), room);
+					++room;
+				}
+			}
+			m_roomStamp.assign(static_cast<size_t>(room), 0);
+			m_roomDirty.assign(static_cast<size_t>(room), static_cast<char>(Clean));
+		}
+
+		//seedから狭さの同じ未分類のセルを上下左右にたどり、roomの番号を付ける
+		//Follow unlabelled cells of the same narrowness up, down, left and right from seed and number them room.
+		void fillRoom(const Point& seed, int room)
+		{
+			const char narrow = m_narrow[seed];
+			m_roomOf[seed] = room;
+			m_cells.clear();
+			m_cells.push_back(seed);
+			while (!m_cells.empty())
+			{
+				const Point cell = m_cells.back();
+				m_cells.pop_back();
+				for (int i : { 1, 3, 4, 6 })
+				{
+					const Point neighbor = cell + directions()[i];
+					if (m_roomOf.isValid(neighbor) && m_roomOf[neighbor] == Unlabelled && m_narrow[neighbor] == narrow)
+					{
+						m_roomOf[neighbor] = room;
+						m_cells.push_back(neighbor);
+					}
+				}
+			}
+		}
+
+		//areaにかかる部屋のセルを未分類に戻して番号を空け、changedの中のセルを新しい壁に合わせる。戻したセルはm_refilledCellsに残す
+		//Return cells of rooms reaching into area to unlabelled and free their numbers, and set cells inside changed to the new walls. The returned cells are kept in m_refilledCells.
+		void clearRooms(const Grid2D<char>& walls, char wall, const Rect& changed, const Rect& area)
+		{
+			m_refilledCells.clear();
+			m_freeRooms.clear();
+			for (int y = area.y; y < area.y + area.h; ++y)
+			{
+				for (int x = area.x; x < area.x + area.w; ++x)
+				{
+					const int room = m_roomOf[y][x];
+					if (room < 0)
+					{
+						continue;
+					}
+
+					m_freeRooms.push_back(room);
+					m_roomDirty[room] = Refilled;
+
+					//部屋は上下左右につながっているので、同じ番号をたどれば全体が見つかる
+					//A room is connected up, down, left and right, so following the same number finds all of it.
+					const size_t first = m_refilledCells.size();
+					m_roomOf[y][x] = Unlabelled;
+					m_refilledCells.emplace_back(x, y);
+					for (size_t i = first; i < m_refilledCells.size(); ++i)
+					{
+						for (int k : { 1, 3, 4, 6 })
+						{
+							const Point neighbor = m_refilledCells[i] + directions()[k];
+							if (m_roomOf.isValid(neighbor) && m_roomOf[neighbor] == room)
+							{
+								m_roomOf[neighbor] = Unlabelled;
+								m_refilledCells.push_back(neighbor);
+							}
+						}
+					}
+				}
+			}
+
+			for (int y = changed.y; y < changed.y + changed.h; ++y)
+			{
+				for (int x = changed.x; x < changed.x + changed.w; ++x)
+				{
+					if (walls[y][x] == wall)
+					{
+						m_roomOf[y][x] = NoRoom;
+					}
+					else if (m_roomOf[y][x] == NoRoom)
+					{
+						m_roomOf[y][x] = Unlabelled;
+						m_refilledCells.emplace_back(x, y);
+					}
+				}
+			}
+		}
+
+		//未分類に戻したセルを部屋に分け直す。空いた番号から使い、足りなければ新しい番号を足す。使われなかった番号はセルのない部屋として残る
+		//Split the returned cells into rooms again. Freed numbers are used first and new numbers are added when they run out. Unused numbers remain as rooms without cells.
+		void refillRooms()
+		{
+			std::sort(m_freeRooms.begin(), m_freeRooms.end(), std::greater<int>());
+			for (const auto& cell : m_refilledCells)
+			{
+				if (m_roomOf[cell] != Unlabelled)
+				{
+					continue;
+				}
+
+				int room;
+				if (m_freeRooms.empty())
+				{
+					room = static_cast<int>(m_roomStamp.size());
+					m_roomStamp.push_back(0);
+					m_roomDirty.push_back(Refilled);
+				}
+				else
+				{
+					room = m_freeRooms.back();
+					m_freeRooms.pop_back();
+				}
+				fillRoom(cell, room);
+			}
+
+			//塗り直したセルへ出口を持つ部屋は、出口の分け方が変わるので作り直す
+			//Rooms with exits into refilled cells have their exits split differently, so they are rebuilt too.
+			for (const auto& cell : m_refilledCells)
+			{
+				for (const auto& direction : directions())
+				{
+					const Point neighbor = cell + direction;
+					if (m_roomOf.isValid(neighbor) && m_roomOf[neighbor] != NoRoom && m_roomDirty[m_roomOf[neighbor]] == Clean)
+					{
+						m_roomDirty[m_roomOf[neighbor]] = Borders;
+					}
+				}
+			}
+		}
+
+		//隣の部屋へ1歩で移れるセルを、部屋と移る先の組ごとに出口にまとめる
+		//Group cells stepping into a neighbouring room in one step into exits per pair of room and destination.
+		void buildExits()
+		{
+			m_exitCells.clear();
+			for (int y = 0; y < static_cast<int>(m_roomOf.height()); ++y)
+			{
+				for (int x = 0; x < static_cast<int>(m_roomOf.width()); ++x)
+				{
+					addExitCells(Point(x, y));
+				}
+			}
+			groupExits();
+		}
+
+		void addExitCells(const Point& cell)
+		{
+			const int room = m_roomOf[cell];
+			if (room == NoRoom)
+			{
+				return;
+			}
+
+			for (const auto& direction : directions())
+			{
+				if (canStep(cell, direction) && m_roomOf[cell + direction] != room)
+				{
+					m_exitCells.push_back({ room, m_roomOf[cell + direction], cell });
+				}
+			}
+		}
+
+		//m_exitCellsを部屋と移る先の組ごとに出口にまとめる
+		//Group m_exitCells into exits per pair of room and destination.
+		void groupExits()
+		{
+			std::sort(m_exitCells.begin(), m_exitCells.end(), [](const ExitCell& a, const ExitCell& b)
+			{
+				return isBefore(a.room, a.target, b.room, b.target);
+			});
+
+			m_exits.clear();
+			m_exitCellBegin.clear();
+			for (size_t i = 0; i < m_exitCells.size(); ++i)
+			{
+				const ExitCell& exitCell = m_exitCells[i];
+				if (m_exits.empty() || m_exits.back().room != exitCell.room || m_exits.back().target != exitCell.target)
+				{
+					m_exits.push_back({ exitCell.room, exitCell.target, -1, Rect(exitCell.cell.x, exitCell.cell.y, 1, 1) });
+					m_exitCellBegin.push_back(i);
+				}
+
+				Rect& bounds = m_exits.back().bounds;
+				const int beginX = Min(bounds.x, exitCell.cell.x);
+				const int beginY = Min(bounds.y, exitCell.cell.y);
+				const int endX = Max(bounds.x + bounds.w, exitCell.cell.x + 1);
+				const int endY = Max(bounds.y + bounds.h, exitCell.cell.y + 1);
+				bounds = Rect(beginX, beginY, endX - beginX, endY - beginY);
+			}
+			m_exitCellBegin.push_back(m_exitCells.size());
+
+			//部屋rの出口は [m_roomExitBegin[r], m_roomExitBegin[r + 1])
+			//Exits of room r are [m_roomExitBegin[r], m_roomExitBegin[r + 1]).
+			m_roomExitBegin.assign(m_roomStamp.size() + 1, 0);
+			for (const auto& exit : m_exits)
+			{
+				++m_roomExitBegin[exit.room + 1];
+			}
+			for (size_t r = 1; r < m_roomExitBegin.size(); ++r)
+			{
+				m_roomExitBegin[r] += m_roomExitBegin[r - 1];
+			}
+
+			//移る先は戻る向きにも移れるので、向かい合う出口は必ずある
+			//A step can also be taken backwards, so the facing exit always exists.
+			for (auto& exit : m_exits)
+			{
+				const auto it = std::lower_bound(m_exits.begin(), m_exits.end(), exit, [](const Exit& a, const Exit& b)
+				{
+					return isBefore(a.room, a.target, b.target, b.room);
+				});
+				exit.peer = static_cast<int>(it - m_exits.begin());
+			}
+		}
+
+		//部屋ごとに、各出口から幅優先探索で同じ部屋の出口までの歩数を求める
+		//Per room, find steps from each exit to the exits of the same room by breadth-first search.
+		void measureExits()
+		{
+			const int unreached = Unreached;
+			m_steps.resize(m_roomOf.width(), m_roomOf.height());
+			m_steps.reset(unreached);
+
+			allocateDistances();
+			for (int room = 0; room + 1 < static_cast<int>(m_roomExitBegin.size()); ++room)
+			{
+				measureRoom(room);
+			}
+
+			m_best.assign(m_exits.size(), unreached);
+			m_bestStamp.assign(m_exits.size(), 0);
+		}
+
+		void allocateDistances()
+		{
+			m_distanceBegin.assign(m_roomExitBegin.size(), 0);
+			for (size_t r = 0; r + 1 < m_roomExitBegin.size(); ++r)
+			{
+				const size_t count = m_roomExitBegin[r + 1] - m_roomExitBegin[r];
+				m_distanceBegin[r + 1] = m_distanceBegin[r] + count*count;
+			}
+			const int unreached = Unreached;
+			m_distances.assign(m_distanceBegin.back(), unreached);
+		}
+
+		//roomの各出口から幅優先探索で同じ部屋の出口までの歩数を求める。m_stepsはすべてUnreachedにしておくこと
+		//Find steps from each exit of room to the exits of the same room by breadth-first search. m_steps must be all Unreached.
+		void measureRoom(int room)
+		{
+			const int unreached = Unreached;
+			for (int e = m_roomExitBegin[room]; e < m_roomExitBegin[room + 1]; ++e)
+			{
+				m_cells.clear();
+				for (size_t i = m_exitCellBegin[e]; i < m_exitCellBegin[e + 1]; ++i)
+				{
+					const Point cell = m_exitCells[i].cell;
+					if (m_steps[cell] == Unreached)
+					{
+						m_steps[cell] = 0;
+						m_cells.push_back(cell);
+					}
+				}
+
+				for (size_t i = 0; i < m_cells.size(); ++i)
+				{
+					const Point cell = m_cells[i];
+					for (const auto& direction : directions())
+					{
+						const Point neighbor = cell + direction;
+						if (canStep(cell, direction) && m_roomOf[neighbor] == room && m_steps[neighbor] == Unreached)
+						{
+							m_steps[neighbor] = m_steps[cell] + 1;
+							m_cells.push_back(neighbor);
+						}
+					}
+				}
+
+				const int first = m_roomExitBegin[room];
+				const int count = m_roomExitBegin[room + 1] - first;
+				for (int f = first; f < first + count; ++f)
+				{
+					int closest = Unreached;
+					for (size_t i = m_exitCellBegin[f]; i < m_exitCellBegin[f + 1]; ++i)
+					{
+						closest = Min(closest, m_steps[m_exitCells[i].cell]);
+					}
+					m_distances[m_distanceBegin[room] + (e - first)*count + (f - first)] = closest;
+				}
+
+				for (const auto& cell : m_cells)
+				{
+					m_steps[cell] = unreached;
+				}
+			}
+		}
+
+		//印の付いた部屋の出口だけを作り直して測る。ほかの部屋の出口のセルと歩数の表は、部屋の中の出口の順が変わらないのでそのまま写す
+		//Rebuild and measure exits of marked rooms only. Exit cells and step tables of other rooms are copied as they are, since the order of exits within the room does not change.
+		void rebuildDirtyExits()
+		{
+			m_oldExitCells.swap(m_exitCells);
+			m_oldExits.swap(m_exits);
+			m_oldExitCellBegin.swap(m_exitCellBegin);
+			m_oldRoomExitBegin.swap(m_roomExitBegin);
+			m_oldDistanceBegin.swap(m_distanceBegin);
+			m_oldDistances.swap(m_distances);
+
+			m_exitCells.clear();
+			for (const auto& exitCell : m_oldExitCells)
+			{
+				if (m_roomDirty[exitCell.room] == Clean)
+				{
+					m_exitCells.push_back(exitCell);
+				}
+			}
+
+			for (const auto& cell : m_refilledCells)
+			{
+				addExitCells(cell);
+			}
+
+			//隣の部屋は出口のセルが変わらないので、前の出口のセルから移る先だけを求め直す
+			//Exit cells of bordering rooms do not change, so only their destinations are found again from the previous exit cells.
+			const int oldRooms = static_cast<int>(m_oldRoomExitBegin.size()) - 1;
+			for (int room = 0; room < oldRooms; ++room)
+			{
+				if (m_roomDirty[room] != Borders)
+				{
+					continue;
+				}
+
+				//同じセルは移る先ごとに何度も現れるので、1つにまとめてから調べる
+				//The same cell appears once per destination, so duplicates are merged before the check.
+				m_cells.clear();
+				for (size_t i = m_oldExitCellBegin[m_oldRoomExitBegin[room]]; i < m_oldExitCellBegin[m_oldRoomExitBegin[room + 1]]; ++i)
+				{
+					m_cells.push_back(m_oldExitCells[i].cell);
+				}
+				std::sort(m_cells.begin(), m_cells.end(), [](const Point& a, const Point& b)
+				{
+					return a.y != b.y ? a.y < b.y : a.x < b.x;
+				});
+				m_cells.erase(std::unique(m_cells.begin(), m_cells.end(), [](const Point& a, const Point& b)
+				{
+					return a.x == b.x && a.y == b.y;
+				}), m_cells.end());
+
+				for (const auto& cell : m_cells)
+				{
+					addExitCells(cell);
+				}
+			}
+			groupExits();
+
+			allocateDistances();
+			for (int room = 0; room + 1 < static_cast<int>(m_roomExitBegin.size()); ++room)
+			{
+				if (m_roomDirty[room] == Clean)
+				{
+					std::copy(m_oldDistances.begin() + m_oldDistanceBegin[room], m_oldDistances.begin() + m_oldDistanceBegin[room + 1], m_distances.begin() + m_distanceBegin[room]);
+				}
+				else
+				{
+					measureRoom(room);
+				}
+			}
+
+			const int unreached = Unreached;
+			m_best.assign(m_exits.size(), unreached);
+			m_bestStamp.assign(m_exits.size(), 0);
+		}
+
+		//centerからsteps歩以内に入れる部屋にm_stampの印を付ける
+		//Mark rooms enterable within steps from center with m_stamp.
+		void findRooms(const Point& center, int steps)
+		{
+			const int start = m_roomOf[center];
+			m_roomStamp[start] = m_stamp;
+
+			m_queue.clear();
+			for (int e = m_roomExitBegin[start]; e < m_roomExitBegin[start + 1]; ++e)
+			{
+				relax(e, chebyshevDistance(center, m_exits[e].bounds), steps);
+			}
+
+			while (!m_queue.empty())
+			{
+				std::pop_heap(m_queue.begin(), m_queue.end(), std::greater<QueueEntry>());
+				const QueueEntry entry = m_queue.back();
+				m_queue.pop_back();
+				if (m_best[entry.exit] < entry.steps)
+				{
+					continue;
+				}
+
+				//隣の部屋へ1歩で移り、その部屋の出口へ進む
+				//Step into the neighbouring room in one step, then move on to the exits of that room.
+				const int peer = m_exits[entry.exit].peer;
+				const int entered = Max(entry.steps + 1, chebyshevDistance(center, m_exits[peer].bounds));
+				if (steps < entered)
+				{
+					continue;
+				}
+
+				const int room = m_exits[peer].room;
+				m_roomStamp[room] = m_stamp;
+
+				const int first = m_roomExitBegin[room];
+				const int count = m_roomExitBegin[room + 1] - first;
+				const int* distances = &m_distances[m_distanceBegin[room] + (peer - first)*count];
+				for (int f = 0; f < count; ++f)
+				{
+					if (distances[f] != Unreached)
+					{
+						relax(first + f, Max(entered + distances[f], chebyshevDistance(center, m_exits[first + f].bounds)), steps);
+					}
+				}
+			}
+		}
+
+		void relax(int exit, int reached, int steps)
+		{
+			if (steps < reached)
+			{
+				return;
+			}
+
+			if (m_bestStamp[exit] != m_stamp)
+			{
+				m_bestStamp[exit] = m_stamp;
+				m_best[exit] = Unreached;
+			}
+
+			if (m_best[exit] <= reached)
+			{
+				return;
+			}
+
+			m_best[exit] = reached;
+			m_queue.push_back({ reached, exit });
+			std::push_heap(m_queue.begin(), m_queue.end(), std::greater<QueueEntry>());
+		}
+
+		Grid2D<char> m_narrow;
+		Grid2D<int> m_roomOf;
+		std::vector<Exit> m_exits;
+		std::vector<ExitCell> m_exitCells;
+		std::vector<size_t> m_exitCellBegin;
+		std::vector<int> m_roomExitBegin;
+
+		//部屋rの出口の間の歩数は m_distances[m_distanceBegin[r]] からの出口の数の2乗の表
+		//Steps between exits of room r are a table of the square of its exit count from m_distances[m_distanceBegin[r]].
+		std::vector<size_t> m_distanceBegin;
+		std::vector<int> m_distances;
+
+		Grid2D<int> m_steps;
+		std::vector<Point> m_cells;
+		std::vector<int> m_best;
+		std::vector<uint32> m_bestStamp;
+		std::vector<uint32> m_roomStamp;
+		uint32 m_stamp = 0;
+		std::vector<QueueEntry> m_queue;
+
+		//作り直しの途中で使う
+		//Used while rebuilding.
+		std::vector<char> m_roomDirty;
+		std::vector<Point> m_refilledCells;
+		std::vector<int> m_freeRooms;
+		std::vector<ExitCell> m_oldExitCells;
+		std::vector<Exit> m_oldExits;
+		std::vector<size_t> m_oldExitCellBegin;
+		std::vector<int> m_oldRoomExitBegin;
+		std::vector<size_t> m_oldDistanceBegin;
+		std::vector<int> m_oldDistances;
+	};
+}
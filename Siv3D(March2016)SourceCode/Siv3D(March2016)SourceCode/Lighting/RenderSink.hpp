@@ -0,0 +1,33 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include "Geometry.hpp"
+
+namespace lighting
+{
+	//フィールドの描画先。座標はすべてピクセル単位
+	//Field::drawは各セルと各ライトについて一度ずつ呼ぶ
+	//Destination of drawing the field. All coordinates are in pixels.
+	//Field::draw calls it once for each cell and each light.
+	class RenderSink
+	{
+	public:
+
+		virtual ~RenderSink() = default;
+
+		//壁でないセルをその明るさで描く
+		//Draws a cell that is not a wall with its brightness.
+		virtual void drawCell(const Rect& rect, const ColorF& brightness) = 0;
+
+		virtual void drawWall(const Rect& rect) = 0;
+
+		virtual void drawLight(const Circle& light, const ColorF& color) = 0;
+	};
+}
@@ -0,0 +1,408 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "Geometry.hpp"
+#include "Grid2D.hpp"
+
+namespace lighting
+{
+	//壁でないセルを上下左右のつながりで部屋に分けたラベル。光は斜めにも進むが、両脇が壁の斜めは遮られるので同じ分け方になる
+	//壁を取り除いたときはUnion-Findでつなぎ、壁を置いたときは置いた場所の周りから探索して、切り離された側だけに新しいラベルを付ける
+	//Labels splitting non-wall cells into rooms connected up, down, left and right. Light also moves diagonally, but a diagonal between two walls is blocked, so the split is the same.
+	//Removing walls joins rooms with union-find, and placing walls searches from around the placed cells and gives new labels only to the parts cut off.
+	class RoomLabels
+	{
+	public:
+
+		static const int NoRoom = -1;
+
+		void rebuild(const Grid2D<char>& walls, char wall)
+		{
+			const int width = static_cast<int>(walls.width());
+			const int height = static_cast<int>(walls.height());
+
+			m_labels.resize(walls.width(), walls.height());
+			m_parent.clear();
+			m_bounds.clear();
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					if (walls[y][x] == wall)
+					{
+						m_labels[y][x] = NoRoom;
+						continue;
+					}
+
+					const int left = 0 < x ? m_labels[y][x - 1] : NoRoom;
+					const int up = 0 < y ? m_labels[y - 1][x] : NoRoom;
+					m_labels[y][x] = left != NoRoom ? left : up != NoRoom ? up : newLabel(Point(x, y));
+					if (left != NoRoom && up != NoRoom)
+					{
+						unite(left, up);
+					}
+				}
+			}
+			flatten();
+
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					if (m_labels[y][x] != NoRoom)
+					{
+						extend(m_bounds[m_parent[m_labels[y][x]]], Point(x, y));
+					}
+				}
+			}
+
+			m_search.resize(walls.width(), walls.height());
+			m_search.reset(NoSearch);
+		}
+
+		//dirtyの中の壁が変わったときに呼ぶ
+		//Called when walls inside dirty change.
+		void update(const Grid2D<char>& walls, char wall, const Rect& dirty)
+		{
+			const int width = static_cast<int>(walls.width());
+			const int height = static_cast<int>(walls.height());
+
+			//ラベルが増え続けないように、格子のセル数の2倍を超えたら作り直す
+			//Rebuild once labels exceed twice the cells of the grid, so they do not keep growing.
+			if (2 * walls.width()*walls.height() < m_parent.size())
+			{
+				rebuild(walls, wall);
+				return;
+			}
+
+			const int beginX = Max(dirty.x, 0);
+			const int beginY = Max(dirty.y, 0);
+			const int endX = Min(dirty.x + dirty.w, width);
+			const int endY = Min(dirty.y + dirty.h, height);
+
+			bool placed = false;
+			bool removed = false;
+			for (int y = beginY; y < endY; ++y)
+			{
+				for (int x = beginX; x < endX; ++x)
+				{
+					const bool isWall = walls[y][x] == wall;
+					if (isWall && m_labels[y][x] != NoRoom)
+					{
+						m_labels[y][x] = NoRoom;
+						placed = true;
+					}
+					else if (!isWall && m_labels[y][x] == NoRoom)
+					{
+						m_labels[y][x] = newLabel(Point(x, y));
+						removed = true;
+					}
+				}
+			}
+
+			//空いたセルを隣の部屋とつなぐ
+			//Join opened cells with the neighbouring rooms.
+			if (removed)
+			{
+				for (int y = beginY; y < endY; ++y)
+				{
+					for (int x = beginX; x < endX; ++x)
+					{
+						if (m_labels[y][x] == NoRoom)
+						{
+							continue;
+						}
+
+						for (const auto& direction : directions())
+						{
+							const Point neighbor(x + direction.x, y + direction.y);
+							if (m_labels.isValid(neighbor) && m_labels[neighbor] != NoRoom)
+							{
+								unite(m_labels[y][x], m_labels[neighbor]);
+							}
+						}
+					}
+				}
+				flatten();
+			}
+
+			//壁で分かれたかもしれない部屋を、dirtyとその周囲1セルの壁でないセルから探す
+			//Look for rooms that walls may have split, from the non-wall cells of dirty and the 1-cell ring around it.
+			if (placed)
+			{
+				m_seeds.clear();
+				for (int y = Max(beginY - 1, 0); y < Min(endY + 1, height); ++y)
+				{
+					for (int x = Max(beginX - 1, 0); x < Min(endX + 1, width); ++x)
+					{
+						if (m_labels[y][x] != NoRoom)
+						{
+							m_seeds.emplace_back(x, y);
+						}
+					}
+				}
+
+				std::stable_sort(m_seeds.begin(), m_seeds.end(), [this](const Point& a, const Point& b)
+				{
+					return room(a) < room(b);
+				});
+
+				for (size_t first = 0; first < m_seeds.size();)
+				{
+					size_t last = first + 1;
+					while (last < m_seeds.size() && room(m_seeds[last]) == room(m_seeds[first]))
+					{
+						++last;
+					}
+					splitRoom(first, last);
+					first = last;
+				}
+			}
+		}
+
+		//セルの部屋。壁ならNoRoom
+		//Room of a cell. NoRoom for walls.
+		int room(const Point& cell)const
+		{
+			const int label = m_labels[cell];
+			return label == NoRoom ? NoRoom : m_parent[label];
+		}
+
+		//部屋の番号はこの数より小さい
+		//Room numbers are less than this count.
+		size_t labelCount()const
+		{
+			return m_parent.size();
+		}
+
+		//部屋のセルをすべて含む矩形。壁を置いても縮めないので、実際より大きいことがある
+		//Rectangle containing all cells of a room. It does not shrink when walls are placed, so it may be larger than needed.
+		const Rect& bounds(int room)const
+		{
+			return m_bounds[room];
+		}
+
+	private:
+
+		static const std::array<Point, 4>& directions()
+		{
+			static const std::array<Point, 4> result = { { Point(0, -1), Point(-1, 0), Point(1, 0), Point(0, 1) } };
+			return result;
+		}
+
+		static const int NoSearch = -1;
+
+		//壁を置いた場所の周りから広げる探索。cellsは訪れたセル、stackはまだ近傍を調べていないセル
+		//Search spreading from around placed walls. cells are the visited cells, and stack the cells whose neighbors are not yet examined.
+		struct Search
+		{
+			int parent;
+			std::vector<Point> cells;
+			std::vector<Point> stack;
+		};
+
+		int newLabel(const Point& cell)
+		{
+			m_parent.push_back(static_cast<int>(m_parent.size()));
+			m_bounds.push_back(Rect(cell.x, cell.y, 1, 1));
+			return m_parent.back();
+		}
+
+		static void extend(Rect& rect, const Point& cell)
+		{
+			const int beginX = Min(rect.x, cell.x);
+			const int beginY = Min(rect.y, cell.y);
+			const int endX = Max(rect.x + rect.w, cell.x + 1);
+			const int endY = Max(rect.y + rect.h, cell.y + 1);
+			rect = Rect(beginX, beginY, endX - beginX, endY - beginY);
+		}
+
+		static Rect merged(const Rect& a, const Rect& b)
+		{
+			Rect result = a;
+			extend(result, Point(b.x, b.y));
+			extend(result, Point(b.x + b.w - 1, b.y + b.h - 1));
+			return result;
+		}
+
+		int find(int label)const
+		{
+			while (m_parent[label] != label)
+			{
+				label = m_parent[label];
+			}
+			return label;
+		}
+
+		//根は小さい方のラベルにそろえるので、親は常に自分以下になる
+		//The smaller label becomes the root, so a parent never exceeds its child.
+		void unite(int a, int b)
+		{
+			a = find(a);
+			b = find(b);
+			if (a < b)
+			{
+				m_parent[b] = a;
+				m_bounds[a] = merged(m_bounds[a], m_bounds[b]);
+			}
+			else if (b < a)
+			{
+				m_parent[a] = b;
+				m_bounds[b] = merged(m_bounds[b], m_bounds[a]);
+			}
+		}
+
+		//親が自分以下なので、小さいラベルから順に親を根に置き換えれば一度で済む
+		//Parents never exceed their children, so replacing parents with roots in ascending order takes a single pass.
+		void flatten()
+		{
+			for (size_t i = 0; i < m_parent.size(); ++i)
+			{
+				m_parent[i] = m_parent[m_parent[i]];
+			}
+		}
+
+		//m_seeds[first, last) は同じ部屋のセル。各セルから探索を1セルずつ交互に広げ、出会った探索は1つにまとめる
+		//ほかと出会わずに広げ終えた探索は切り離された部分なので、新しいラベルを付ける。広げている探索が1つになったら、残りは元のラベルのままでよい
+		//切り離された部分の大きさの探索の数倍しかセルを訪れないので、壁で分かれなかった部屋や大きい側を塗り直すことはない
+		//m_seeds[first, last) are cells of the same room. Searches from each cell are widened one cell at a time by turns, and searches that meet are merged.
+		//A search finished without meeting another is a part cut off, so it gets a new label. Once only one search is still widening, the rest keeps the original label.
+		//Cells visited are only a few times the size of the parts cut off, so a room not split by walls, or its larger side, is never refilled.
+		void splitRoom(size_t first, size_t last)
+		{
+			const int room = this->room(m_seeds[first]);
+			m_searches.resize(last - first);
+			m_active.clear();
+			for (size_t i = 0; i < last - first; ++i)
+			{
+				Search& search = m_searches[i];
+				search.parent = static_cast<int>(i);
+				search.cells.clear();
+				search.stack.clear();
+
+				const Point seed = m_seeds[first + i];
+				m_search[seed] = static_cast<int>(i);
+				search.cells.push_back(seed);
+				search.stack.push_back(seed);
+				m_active.push_back(static_cast<int>(i));
+			}
+
+			while (1 < m_active.size())
+			{
+				for (size_t k = 0; k < m_active.size() && 1 < m_active.size();)
+				{
+					const int id = m_active[k];
+					Search& search = m_searches[id];
+					if (search.parent != id)
+					{
+						m_active[k] = m_active.back();
+						m_active.pop_back();
+						continue;
+					}
+
+					if (search.stack.empty())
+					{
+						const int label = newLabel(search.cells.front());
+						for (const auto& cell : search.cells)
+						{
+							m_labels[cell] = label;
+							extend(m_bounds[label], cell);
+						}
+						m_active[k] = m_active.back();
+						m_active.pop_back();
+						continue;
+					}
+
+					//まとめると大きい方の探索に移るので、訪れたセルは根の探索に加える
+					//Merging moves into the larger search, so visited cells are added to the root search.
+					const Point cell = search.stack.back();
+					search.stack.pop_back();
+					for (const auto& direction : directions())
+					{
+						const Point neighbor(cell.x + direction.x, cell.y + direction.y);
+						if (!m_labels.isValid(neighbor) || m_labels[neighbor] == NoRoom || this->room(neighbor) != room)
+						{
+							continue;
+						}
+
+						const int root = findSearch(id);
+						if (m_search[neighbor] == NoSearch)
+						{
+							m_search[neighbor] = root;
+							m_searches[root].cells.push_back(neighbor);
+							m_searches[root].stack.push_back(neighbor);
+						}
+						else
+						{
+							uniteSearches(root, m_search[neighbor]);
+						}
+					}
+					++k;
+				}
+			}
+
+			for (auto& search : m_searches)
+			{
+				for (const auto& cell : search.cells)
+				{
+					m_search[cell] = NoSearch;
+				}
+			}
+		}
+
+		int findSearch(int id)
+		{
+			while (m_searches[id].parent != id)
+			{
+				id = m_searches[id].parent;
+			}
+			return id;
+		}
+
+		//小さい方の探索を大きい方へまとめる
+		//Merge the smaller search into the larger one.
+		void uniteSearches(int a, int b)
+		{
+			a = findSearch(a);
+			b = findSearch(b);
+			if (a == b)
+			{
+				return;
+			}
+
+			if (m_searches[a].cells.size() < m_searches[b].cells.size())
+			{
+				std::swap(a, b);
+			}
+
+			Search& into = m_searches[a];
+			Search& from = m_searches[b];
+			into.cells.insert(into.cells.end(), from.cells.begin(), from.cells.end());
+			into.stack.insert(into.stack.end(), from.stack.begin(), from.stack.end());
+			from.cells.clear();
+			from.stack.clear();
+			from.parent = a;
+		}
+
+		Grid2D<int> m_labels;
+		std::vector<int> m_parent;
+		std::vector<Rect> m_bounds;
+
+		//壁を置いたときの探索で使う。m_searchはセルを訪れた探索（訪れていなければNoSearch）
+		//Used by searches when walls are placed. m_search is the search that visited a cell (NoSearch if none).
+		Grid2D<int> m_search;
+		std::vector<Point> m_seeds;
+		std::vector<Search> m_searches;
+		std::vector<int> m_active;
+	};
+}
@@ -0,0 +1,106 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include "Geometry.hpp"
+#include "Grid2D.hpp"
+#include "WallDistance.hpp"
+
+namespace lighting
+{
+	//壁の表面までの符号付き距離[セル]。壁のない側が正、壁の中が負。格子の外は壁とみなす
+	//セルの中心では、壁のないセルは最も近い壁のセルまで、壁のセルは最も近い壁のないセルまでの距離から半セルを引いた値を持ち、その間は双線形に補間する
+	//Signed distance [cells] to the wall surface, positive on the open side and negative inside walls. Outside the grid counts as wall.
+	//At cell centres, open cells hold the distance to the nearest wall cell and wall cells the distance to the nearest open cell, minus half a cell; values in between are interpolated bilinearly.
+	class SignedWallDistance
+	{
+	public:
+
+		//距離と、距離が増える向きの勾配[セル/セル]
+		//Distance and its gradient [cells/cell], pointing the way distance increases.
+		struct Sample
+		{
+			double distance;
+			Vec2 gradient;
+		};
+
+		void rebuild(const Grid2D<char>& walls, char wall, char space, Executor& executor)
+		{
+			m_distance.resize(walls.width(), walls.height());
+			m_toWall.rebuild(walls, wall, executor);
+			m_toSpace.rebuild(walls, space, executor);
+			update(walls, wall, space, Rect(0, 0, static_cast<int>(walls.width()), static_cast<int>(walls.height())), executor);
+		}
+
+		//dirtyの中の壁が変わったときに呼ぶ。WallDistanceと同じく周囲MaxDistanceの範囲だけを計算し直す
+		//Called when walls inside dirty change. As with WallDistance, only the surrounding MaxDistance is recomputed.
+		void update(const Grid2D<char>& walls, char wall, char space, const Rect& dirty, Executor& executor)
+		{
+			m_toWall.update(walls, wall, dirty, executor);
+			m_toSpace.update(walls, space, dirty, executor);
+
+			const int maxDistance = WallDistance::MaxDistance;
+			const int beginX = Max(dirty.x - maxDistance, 0);
+			const int beginY = Max(dirty.y - maxDistance, 0);
+			const int endX = Min(dirty.x + dirty.w + maxDistance, static_cast<int>(walls.width()));
+			const int endY = Min(dirty.y + dirty.h + maxDistance, static_cast<int>(walls.height()));
+			if (endX <= beginX || endY <= beginY)
+			{
+				return;
+			}
+
+			executor.parallelFor(static_cast<size_t>(endY - beginY), [&](size_t i)
+			{
+				const int y = beginY + static_cast<int>(i);
+				for (int x = beginX; x < endX; ++x)
+				{
+					const Point cell(x, y);
+					m_distance[y][x] = walls[y][x] == wall
+						? static_cast<float>(0.5 - Sqrt(m_toSpace.squaredDistance(cell)))
+						: static_cast<float>(Sqrt(m_toWall.squaredDistance(cell)) - 0.5);
+				}
+			}, Max<size_t>(4096 / static_cast<size_t>(endX - beginX), 1u));
+		}
+
+		//posはセル単位の位置で、セル(x, y)は [x, x + 1) x [y, y + 1) を占める。格子の外では端の2列から外挿する
+		//pos is a position in cells, cell (x, y) covering [x, x + 1) x [y, y + 1). Outside the grid, the two outermost columns or rows are extrapolated.
+		Sample sample(const Vec2& pos)const
+		{
+			const double u = pos.x - 0.5;
+			const double v = pos.y - 0.5;
+			const int x0 = Clamp(static_cast<int>(Floor(u)), 0, static_cast<int>(m_distance.width()) - 2);
+			const int y0 = Clamp(static_cast<int>(Floor(v)), 0, static_cast<int>(m_distance.height()) - 2);
+			const double fx = u - x0;
+			const double fy = v - y0;
+
+			const double d00 = m_distance[y0][x0];
+			const double d10 = m_distance[y0][x0 + 1];
+			const double d01 = m_distance[y0 + 1][x0];
+			const double d11 = m_distance[y0 + 1][x0 + 1];
+
+			Sample result;
+			result.distance = (1.0 - fy)*((1.0 - fx)*d00 + fx*d10) + fy*((1.0 - fx)*d01 + fx*d11);
+			result.gradient = Vec2((1.0 - fy)*(d10 - d00) + fy*(d11 - d01), (1.0 - fx)*(d01 - d00) + fx*(d11 - d10));
+			return result;
+		}
+
+		//壁のないセルから最も近い壁のセルまでの距離
+		//Distance from open cells to the nearest wall cell.
+		const WallDistance& toWall()const
+		{
+			return m_toWall;
+		}
+
+	private:
+
+		WallDistance m_toWall;
+		WallDistance m_toSpace = WallDistance(false);
+		Grid2D<float> m_distance;
+	};
+}
@@ -0,0 +1,164 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <array>
+#include <vector>
+#include "Geometry.hpp"
+#include "Parallel.hpp"
+
+namespace lighting
+{
+	//一様格子のセルをハッシュ表のバケットに割り当てる空間ハッシュ
+	//毎フレーム並列の計数ソートで作り直すので、近傍探索は全体でO(n)になる
+	//Spatial hash assigning uniform grid cells to buckets of a hash table.
+	//Rebuilt every frame with a parallel counting sort, so neighbor queries are O(n) overall.
+	class SpatialHash
+	{
+	public:
+
+		void build(const std::vector<Circle>& circles, double cellSize, Executor& executor)
+		{
+			const size_t count = circles.size();
+			m_cellSize = cellSize;
+
+			m_bucketCount = 1;
+			while (m_bucketCount < count * 2)
+			{
+				m_bucketCount *= 2;
+			}
+
+			m_keys.resize(count);
+			m_items.resize(count);
+			m_bucketStart.assign(m_bucketCount + 1, 0);
+
+			const size_t numChunks = executor.chunkCount(count, 4096);
+			m_chunkCounts.assign(numChunks*m_bucketCount, 0);
+
+			//各チャンクでバケットごとの個数を数える
+			//Count items per bucket in each chunk.
+			executor.parallelForChunks(count, numChunks, [&](size_t chunk, size_t begin, size_t end)
+			{
+				uint32* counts = m_chunkCounts.data() + chunk*m_bucketCount;
+				for (size_t i = begin; i < end; ++i)
+				{
+					const Point cell = cellOf(circles[i].center);
+					m_keys[i] = bucketOf(cell.x, cell.y);
+					++counts[m_keys[i]];
+				}
+			});
+
+			//バケット範囲ごとに合計を求めて、その後で各チャンクの書き込み開始位置に置き換える
+			//Sum up per bucket range, then replace counts with the write offset of each chunk.
+			const size_t numRanges = executor.chunkCount(m_bucketCount, 4096);
+			std::vector<uint32> rangeOffsets(numRanges + 1, 0);
+			executor.parallelForChunks(m_bucketCount, numRanges, [&](size_t range, size_t begin, size_t end)
+			{
+				uint32 total = 0;
+				for (size_t bucket = begin; bucket < end; ++bucket)
+				{
+					for (size_t chunk = 0; chunk < numChunks; ++chunk)
+					{
+						total += m_chunkCounts[chunk*m_bucketCount + bucket];
+					}
+				}
+				rangeOffsets[range + 1] = total;
+			});
+
+			for (size_t range = 0; range < numRanges; ++range)
+			{
+				rangeOffsets[range + 1] += rangeOffsets[range];
+			}
+
+			executor.parallelForChunks(m_bucketCount, numRanges, [&](size_t range, size_t begin, size_t end)
+			{
+				uint32 offset = rangeOffsets[range];
+				for (size_t bucket = begin; bucket < end; ++bucket)
+				{
+					m_bucketStart[bucket] = offset;
+					for (size_t chunk = 0; chunk < numChunks; ++chunk)
+					{
+						uint32& slot = m_chunkCounts[chunk*m_bucketCount + bucket];
+						const uint32 n = slot;
+						slot = offset;
+						offset += n;
+					}
+				}
+			});
+			m_bucketStart[m_bucketCount] = static_cast<uint32>(count);
+
+			//チャンクごとに自分の書き込み位置へ散らす（安定ソート）
+			//Scatter to each chunk's own write offsets (stable sort).
+			executor.parallelForChunks(count, numChunks, [&](size_t chunk, size_t begin, size_t end)
+			{
+				uint32* offsets = m_chunkCounts.data() + chunk*m_bucketCount;
+				for (size_t i = begin; i < end; ++i)
+				{
+					m_items[offsets[m_keys[i]]++] = static_cast<uint32>(i);
+				}
+			});
+		}
+
+		//posを含むセルとその8近傍のセルに登録された要素を列挙する（距離の判定は呼び出し側で行う）
+		//Enumerate items registered in the cell containing pos and its 8 neighbors (distance test is left to the caller).
+		template<class Func>
+		void forEachNeighbor(const Vec2& pos, Func func)const
+		{
+			if (m_bucketCount == 0)
+			{
+				return;
+			}
+
+			const Point center = cellOf(pos);
+			std::array<uint32, 9> visited;
+			size_t numVisited = 0;
+
+			for (int dy = -1; dy <= 1; ++dy)
+			{
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					const uint32 bucket = bucketOf(center.x + dx, center.y + dy);
+
+					//異なるセルが同じバケットに入ったときに二重に数えないようにする
+					//Avoid visiting twice when different cells fall into the same bucket.
+					if (std::find(visited.begin(), visited.begin() + numVisited, bucket) != visited.begin() + numVisited)
+					{
+						continue;
+					}
+					visited[numVisited++] = bucket;
+
+					for (uint32 i = m_bucketStart[bucket]; i < m_bucketStart[bucket + 1]; ++i)
+					{
+						func(m_items[i]);
+					}
+				}
+			}
+		}
+
+	private:
+
+		Point cellOf(const Vec2& pos)const
+		{
+			return Point(static_cast<int>(Floor(pos.x / m_cellSize)), static_cast<int>(Floor(pos.y / m_cellSize)));
+		}
+
+		uint32 bucketOf(int x, int y)const
+		{
+			const uint32 hash = static_cast<uint32>(x) * 73856093u ^ static_cast<uint32>(y) * 19349663u;
+			return hash & static_cast<uint32>(m_bucketCount - 1);
+		}
+
+		double m_cellSize = 1.0;
+		size_t m_bucketCount = 0;
+		std::vector<uint32> m_keys;
+		std::vector<uint32> m_items;
+		std::vector<uint32> m_bucketStart;
+		std::vector<uint32> m_chunkCounts;
+	};
+}
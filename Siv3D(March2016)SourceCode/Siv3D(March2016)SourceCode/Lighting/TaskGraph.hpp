@@ -0,0 +1,175 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Parallel.hpp"
+
+namespace lighting
+{
+	//依存関係のあるタスクをExecutorで実行する
+	//タスクは依存するタスクがすべて終わった時点で実行可能になる。終わったタスクは忘れるので、グラフはフレームをまたいで伸ばし続けてよい
+	//Runs tasks with dependencies on an Executor.
+	//A task becomes runnable once all the tasks it depends on have finished. Finished tasks are forgotten, so the graph may keep growing across frames.
+	class TaskGraph
+	{
+	public:
+
+		//0は「タスクなし」を表し、依存に渡すと無視される
+		//0 represents "no task" and is ignored when passed as a dependency.
+		using TaskId = uint64;
+
+		explicit TaskGraph(Executor& executor = DefaultExecutor())
+			: m_executor(executor) {}
+
+		TaskGraph(const TaskGraph&) = delete;
+		TaskGraph& operator=(const TaskGraph&) = delete;
+
+		~TaskGraph()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_finished.wait(lock, [this] { return m_tasks.empty(); });
+		}
+
+		TaskId add(std::function<void()> func, const std::vector<TaskId>& dependencies = {})
+		{
+			TaskId id;
+			bool ready;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				id = ++m_lastId;
+				Task& task = m_tasks[id];
+				task.func = std::move(func);
+				for (const TaskId dependency : dependencies)
+				{
+					const auto it = m_tasks.find(dependency);
+					if (it != m_tasks.end())
+					{
+						it->second.dependents.push_back(id);
+						++task.numPending;
+					}
+				}
+				ready = (task.numPending == 0);
+			}
+
+			//Executorはその場でタスクを実行することもあるので、ロックの外で渡す
+			//The executor may run the task in place, so hand it over outside the lock.
+			if (ready)
+			{
+				dispatch(id);
+			}
+
+			return id;
+		}
+
+		//タスクが終わるまで待つ。実行中に投げられた例外があれば、ここで投げ直す
+		//Waits until the task finishes. An exception thrown during execution, if any, is rethrown here.
+		void wait(TaskId id)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_finished.wait(lock, [&] { return m_tasks.find(id) == m_tasks.end(); });
+			rethrow();
+		}
+
+		void waitAll()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_finished.wait(lock, [this] { return m_tasks.empty(); });
+			rethrow();
+		}
+
+		Executor& executor()const
+		{
+			return m_executor;
+		}
+
+	private:
+
+		struct Task
+		{
+			std::function<void()> func;
+			size_t numPending = 0;
+			std::vector<TaskId> dependents;
+		};
+
+		void dispatch(TaskId id)
+		{
+			m_executor.submit([this, id] { run(id); });
+		}
+
+		void run(TaskId id)
+		{
+			std::function<void()> func;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				func = std::move(m_tasks[id].func);
+			}
+
+			std::exception_ptr error;
+			try
+			{
+				func();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			std::vector<TaskId> ready;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (error && !m_error)
+				{
+					m_error = error;
+				}
+
+				//後続のタスクは、例外が出たときも依存が解けたものとして実行する
+				//Dependents run as if the dependency was resolved even when an exception was thrown.
+				const auto it = m_tasks.find(id);
+				for (const TaskId dependent : it->second.dependents)
+				{
+					if (--m_tasks[dependent].numPending == 0)
+					{
+						ready.push_back(dependent);
+					}
+				}
+				m_tasks.erase(it);
+				m_finished.notify_all();
+			}
+
+			for (const TaskId next : ready)
+			{
+				dispatch(next);
+			}
+		}
+
+		void rethrow()
+		{
+			if (m_error)
+			{
+				std::exception_ptr error = m_error;
+				m_error = nullptr;
+				std::rethrow_exception(error);
+			}
+		}
+
+		Executor& m_executor;
+		std::mutex m_mutex;
+		std::condition_variable m_finished;
+		std::unordered_map<TaskId, Task> m_tasks;
+		TaskId m_lastId = 0;
+		std::exception_ptr m_error;
+	};
+}
@@ -0,0 +1,234 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#pragma once
+#include <vector>
+#include "Geometry.hpp"
+#include "Grid2D.hpp"
+#include "Parallel.hpp"
+
+namespace lighting
+{
+	//各セルから最も近い壁のセルまでのユークリッド距離の2乗[セル^2]。edgeIsWallなら格子の外も壁とみなす
+	//距離はMaxDistanceで打ち切るので、壁を書き換えたときは周囲2*MaxDistanceの範囲だけを計算し直せばよい
+	//計算は縦と横に分けた厳密な距離変換（Felzenszwalb–Huttenlocher）で、セルあたりO(1)。列と行はそれぞれexecutorで並列に処理する
+	//Squared Euclidean distance [cells^2] from each cell to the nearest wall cell. Outside the grid also counts as wall when edgeIsWall.
+	//Distances are capped at MaxDistance, so after walls change only the surrounding 2*MaxDistance needs recomputing.
+	//Computed by an exact distance transform separated into columns and rows (Felzenszwalb-Huttenlocher), O(1) per cell. Columns and rows are each processed in parallel on executor.
+	class WallDistance
+	{
+	public:
+
+		static const int MaxDistance = 64;
+
+		explicit WallDistance(bool edgeIsWall = true)
+			: m_edgeIsWall(edgeIsWall) {}
+
+		void rebuild(const Grid2D<char>& walls, char wall, Executor& executor)
+		{
+			m_squaredDistance.resize(walls.width(), walls.height());
+			update(walls, wall, Rect(0, 0, static_cast<int>(walls.width()), static_cast<int>(walls.height())), executor);
+		}
+
+		//dirtyの中の壁が変わったときに呼ぶ
+		//Called when walls inside dirty change.
+		void update(const Grid2D<char>& walls, char wall, const Rect& dirty, Executor& executor)
+		{
+			const int width = static_cast<int>(walls.width());
+			const int height = static_cast<int>(walls.height());
+
+			//書き戻すのはdirtyからMaxDistance以内のセル。その距離を決める壁はさらにMaxDistance以内にある
+			//Cells written back lie within MaxDistance of dirty. Walls deciding their distances lie within a further MaxDistance.
+			const Rect output = Clip(Rect(dirty.x - MaxDistance, dirty.y - MaxDistance, dirty.w + 2 * MaxDistance, dirty.h + 2 * MaxDistance), width, height);
+			const Rect window = Clip(Rect(dirty.x - 2 * MaxDistance, dirty.y - 2 * MaxDistance, dirty.w + 4 * MaxDistance, dirty.h + 4 * MaxDistance), width, height);
+			if (output.w <= 0 || output.h <= 0)
+			{
+				return;
+			}
+
+			//縦方向: 同じ列で最も近い壁までの距離
+			//Columns: distance to the nearest wall in the same column.
+			const int far = MaxDistance + 1;
+			m_column.resize(static_cast<size_t>(window.w)*window.h);
+			executor.parallelFor(static_cast<size_t>(window.w), [&](size_t column)
+			{
+				const int x = static_cast<int>(column);
+				int distance = window.y == 0 && m_edgeIsWall ? 1 : far;
+				for (int y = 0; y < window.h; ++y)
+				{
+					distance = walls[window.y + y][window.x + x] == wall ? 0 : Min(distance + (y == 0 ? 0 : 1), far);
+					m_column[y*window.w + x] = distance;
+				}
+
+				distance = window.y + window.h == height && m_edgeIsWall ? 1 : far;
+				for (int y = window.h - 1; 0 <= y; --y)
+				{
+					distance = m_column[y*window.w + x] == 0 ? 0 : Min(distance + (y == window.h - 1 ? 0 : 1), far);
+					m_column[y*window.w + x] = Min(m_column[y*window.w + x], distance);
+				}
+			}, Max<size_t>(4096 / static_cast<size_t>(window.h), 1u));
+
+			//横方向: 各列の距離を高さとする放物線の下側包絡線を求める。包絡線の作業領域はチャンクごとに持つ
+			//Rows: take the lower envelope of parabolas whose heights are the column distances. Each chunk has its own envelope workspace.
+			const size_t numRows = static_cast<size_t>(output.h);
+			const size_t numChunks = executor.chunkCount(numRows, Max<size_t>(4096 / static_cast<size_t>(window.w), 1u));
+			if (m_envelopes.size() < numChunks)
+			{
+				m_envelopes.resize(numChunks);
+			}
+			executor.parallelForChunks(numRows, numChunks, [&](size_t chunk, size_t begin, size_t end)
+			{
+				Envelope& envelope = m_envelopes[chunk];
+				for (size_t i = begin; i < end; ++i)
+				{
+					updateRow(envelope, output, window, static_cast<int>(i) + output.y - window.y, width);
+				}
+			});
+		}
+
+		//MaxDistance以上はMaxDistance^2になる
+		//Anything at MaxDistance or farther reads as MaxDistance^2.
+		uint32 squaredDistance(const Point& cell)const
+		{
+			return m_squaredDistance[cell];
+		}
+
+		//中心からradius以内（addDiscと同じ円）に壁がなく、格子に収まっていればtrue
+		//True if the disc within radius of center (the same disc as addDisc) has no walls and fits in the grid.
+		bool isDiscClear(const Point& center, double radius)const
+		{
+			return m_squaredDistance.isValid(center) && 0.0 <= radius && radius < MaxDistance
+				&& radius*radius < m_squaredDistance[center];
+		}
+
+		const Grid2D<uint32>& grid()const
+		{
+			return m_squaredDistance;
+		}
+
+	private:
+
+		struct Site
+		{
+			int position;
+			int64 height;
+		};
+
+		static Rect Clip(const Rect& rect, int width, int height)
+		{
+			const int beginX = Max(rect.x, 0);
+			const int beginY = Max(rect.y, 0);
+			const int endX = Min(rect.x + rect.w, width);
+			const int endY = Min(rect.y + rect.h, height);
+			return Rect(beginX, beginY, endX - beginX, endY - beginY);
+		}
+
+		//包絡線を作るための作業領域
+		//Workspace for building an envelope.
+		struct Envelope
+		{
+			std::vector<Site> sites;
+			std::vector<size_t> parabolas;
+			std::vector<double> boundaries;
+		};
+
+		//window内のy行目の列の距離から、outputの範囲の距離を書き込む
+		//Write distances over output from the column distances of row y within window.
+		void updateRow(Envelope& envelope, const Rect& output, const Rect& window, int y, int width)
+		{
+			const int far = MaxDistance + 1;
+			const uint32 capSquared = static_cast<uint32>(MaxDistance*MaxDistance);
+			auto& sites = envelope.sites;
+			sites.clear();
+
+			//edgeIsWallなら格子の左右の外は壁
+			//Left and right of the grid are walls when edgeIsWall.
+			if (window.x == 0 && m_edgeIsWall)
+			{
+				sites.push_back({ -1, 0 });
+			}
+			for (int x = 0; x < window.w; ++x)
+			{
+				const int column = m_column[y*window.w + x];
+				if (column < far)
+				{
+					sites.push_back({ x, static_cast<int64>(column)*column });
+				}
+			}
+			if (window.x + window.w == width && m_edgeIsWall)
+			{
+				sites.push_back({ window.w, 0 });
+			}
+
+			auto row = m_squaredDistance[window.y + y];
+			if (sites.empty())
+			{
+				for (int x = output.x; x < output.x + output.w; ++x)
+				{
+					row[x] = capSquared;
+				}
+				return;
+			}
+
+			buildEnvelope(envelope);
+
+			size_t k = 0;
+			for (int x = output.x - window.x; x < output.x - window.x + output.w; ++x)
+			{
+				while (k + 1 < envelope.parabolas.size() && envelope.boundaries[k + 1] < x)
+				{
+					++k;
+				}
+
+				const Site& site = sites[envelope.parabolas[k]];
+				const int64 squared = static_cast<int64>(x - site.position)*(x - site.position) + site.height;
+				row[window.x + x] = static_cast<uint32>(Min<int64>(squared, capSquared));
+			}
+		}
+
+		//sitesの放物線 (x - position)^2 + height の下側包絡線を作る。boundaries[k]から先はparabolas[k]が最小
+		//Build the lower envelope of parabolas (x - position)^2 + height in sites. parabolas[k] is minimal from boundaries[k] on.
+		static void buildEnvelope(Envelope& envelope)
+		{
+			const auto& sites = envelope.sites;
+			auto& parabolas = envelope.parabolas;
+			auto& boundaries = envelope.boundaries;
+			parabolas.clear();
+			boundaries.clear();
+			for (size_t q = 0; q < sites.size(); ++q)
+			{
+				double boundary = -1e30;
+				while (!parabolas.empty())
+				{
+					const Site& a = sites[parabolas.back()];
+					const Site& b = sites[q];
+					boundary = (static_cast<double>(b.height + static_cast<int64>(b.position)*b.position) - static_cast<double>(a.height + static_cast<int64>(a.position)*a.position))
+						/ (2.0*(b.position - a.position));
+					if (boundary <= boundaries.back())
+					{
+						parabolas.pop_back();
+						boundaries.pop_back();
+						boundary = -1e30;
+					}
+					else
+					{
+						break;
+					}
+				}
+				parabolas.push_back(q);
+				boundaries.push_back(boundary);
+			}
+		}
+
+		bool m_edgeIsWall;
+		Grid2D<uint32> m_squaredDistance;
+		std::vector<int> m_column;
+		std::vector<Envelope> m_envelopes;
+	};
+}
@@ -0,0 +1,563 @@
+﻿/**
+CellularAutomatonLighting2D
+
+Copyright (c) 2016 agehama
+
+This software is released under the MIT License.
+http://opensource.org/licenses/mit-license.php
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <exception>
+#include <new>
+#include "../Lighting/Field.hpp"
+
+//Pythonモジュール lighting
+//Field.wallsとField.brightnessはバッファプロトコルを実装するので、numpy.asarrayはコピーせずにフィールドのメモリを参照する
+//参照が残っている間はstepがBufferErrorになる（bytearrayの大きさを変えられないのと同じ）
+//stepの間はGILを解放するので、複数のフィールドをスレッドプールから並列に動かせる
+//Python module lighting.
+//Field.walls and Field.brightness implement the buffer protocol, so numpy.asarray refers to the memory of the field without copying.
+//While views remain, step raises BufferError (just as a bytearray cannot be resized).
+//The GIL is released during step, so several fields can run in parallel from a thread pool.
+
+namespace
+{
+	struct FieldObject
+	{
+		PyObject_HEAD
+		lighting::Field* field;
+
+		//外に貸しているバッファの数
+		//Number of buffers lent out.
+		Py_ssize_t numExports;
+
+		//GILを解放して計算している間はtrue。その間は他のスレッドからこのフィールドに触れない
+		//True while computing with the GIL released. Other threads cannot touch this field in the meantime.
+		bool busy;
+	};
+
+	enum class GridKind
+	{
+		Walls,
+		Brightness,
+	};
+
+	//フィールドの格子の一つをバッファとして見せるオブジェクト
+	//Object exposing one of the grids of a field as a buffer.
+	struct GridObject
+	{
+		PyObject_HEAD
+		FieldObject* owner;
+		GridKind kind;
+		Py_ssize_t shape[3];
+		Py_ssize_t strides[3];
+	};
+
+	PyTypeObject FieldType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+	PyTypeObject GridType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+	//捕まえているC++の例外をPythonの例外にする。catchの中から呼び、常にnullptrを返す
+	//Turns the C++ exception being handled into a Python exception. Called inside catch, always returns nullptr.
+	PyObject* RaiseCurrentException()
+	{
+		try
+		{
+			throw;
+		}
+		catch (const std::bad_alloc&)
+		{
+			return PyErr_NoMemory();
+		}
+		catch (const std::exception& e)
+		{
+			PyErr_SetString(PyExc_RuntimeError, e.what());
+		}
+		catch (...)
+		{
+			PyErr_SetString(PyExc_RuntimeError, "unknown C++ exception");
+		}
+		return nullptr;
+	}
+
+	bool CheckIdle(FieldObject* self)
+	{
+		if (!self->field)
+		{
+			PyErr_SetString(PyExc_RuntimeError, "the field is not initialized");
+			return false;
+		}
+
+		if (self->busy)
+		{
+			PyErr_SetString(PyExc_RuntimeError, "the field is being stepped on another thread");
+			return false;
+		}
+		return true;
+	}
+
+	bool ParseLight(PyObject* light, lighting::LightHandle& handle)
+	{
+		unsigned int slot;
+		unsigned int generation;
+		if (!PyArg_ParseTuple(light, "II", &slot, &generation))
+		{
+			return false;
+		}
+
+		handle.slot = slot;
+		handle.generation = generation;
+		return true;
+	}
+
+	bool CheckAlive(FieldObject* self, const lighting::LightHandle& handle)
+	{
+		if (!self->field->isAlive(handle))
+		{
+			PyErr_SetString(PyExc_ValueError, "the light has been removed");
+			return false;
+		}
+		return true;
+	}
+
+	int Field_init(FieldObject* self, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "width", "height", "grid_unit_pixel", nullptr };
+		int width;
+		int height;
+		int gridUnitPixel = 8;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|i", const_cast<char**>(keywords), &width, &height, &gridUnitPixel))
+		{
+			return -1;
+		}
+
+		if (gridUnitPixel <= 0 || width < gridUnitPixel || height < gridUnitPixel || width % gridUnitPixel != 0 || height % gridUnitPixel != 0)
+		{
+			PyErr_SetString(PyExc_ValueError, "width and height must be positive multiples of grid_unit_pixel");
+			return -1;
+		}
+
+		if (0 < self->numExports || self->busy)
+		{
+			PyErr_SetString(PyExc_BufferError, "the field is in use");
+			return -1;
+		}
+
+		try
+		{
+			lighting::Field* field = new lighting::Field(lighting::Size(width, height), gridUnitPixel);
+			field->clearLights();
+			delete self->field;
+			self->field = field;
+		}
+		catch (...)
+		{
+			RaiseCurrentException();
+			return -1;
+		}
+
+		return 0;
+	}
+
+	void Field_dealloc(FieldObject* self)
+	{
+		delete self->field;
+		Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+	}
+
+	PyObject* Field_step(FieldObject* self, PyObject*)
+	{
+		if (!CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		if (0 < self->numExports)
+		{
+			PyErr_SetString(PyExc_BufferError, "existing views of the grids must be released before step");
+			return nullptr;
+		}
+
+		//GILを持たない間はPythonの例外を作れないので、例外は持ち帰ってから変換する
+		//Python exceptions cannot be raised without the GIL, so the exception is carried out and converted afterwards.
+		std::exception_ptr error;
+		self->busy = true;
+		Py_BEGIN_ALLOW_THREADS
+		try
+		{
+			self->field->updateLighting();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		Py_END_ALLOW_THREADS
+		self->busy = false;
+
+		if (error)
+		{
+			try
+			{
+				std::rethrow_exception(error);
+			}
+			catch (...)
+			{
+				return RaiseCurrentException();
+			}
+		}
+
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Field_add_light(FieldObject* self, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "x", "y", "color", "intensity", "range", nullptr };
+		double x;
+		double y;
+		double r = 1.0;
+		double g = 1.0;
+		double b = 1.0;
+		double intensity = 1.0;
+		double range = 30.0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "dd|(ddd)dd", const_cast<char**>(keywords), &x, &y, &r, &g, &b, &intensity, &range)
+			|| !CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		try
+		{
+			const lighting::LightHandle handle = self->field->addLight(lighting::Vec2(x, y), lighting::ColorF(r, g, b), lighting::Vec2(0, 0), intensity, range);
+			return Py_BuildValue("(II)", handle.slot, handle.generation);
+		}
+		catch (...)
+		{
+			return RaiseCurrentException();
+		}
+	}
+
+	PyObject* Field_remove_light(FieldObject* self, PyObject* light)
+	{
+		lighting::LightHandle handle;
+		if (!ParseLight(light, handle) || !CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		try
+		{
+			return PyBool_FromLong(self->field->removeLight(handle));
+		}
+		catch (...)
+		{
+			return RaiseCurrentException();
+		}
+	}
+
+	PyObject* Field_move_light(FieldObject* self, PyObject* args)
+	{
+		PyObject* light;
+		double x;
+		double y;
+		lighting::LightHandle handle;
+		if (!PyArg_ParseTuple(args, "Odd", &light, &x, &y) || !ParseLight(light, handle) || !CheckIdle(self) || !CheckAlive(self, handle))
+		{
+			return nullptr;
+		}
+
+		try
+		{
+			self->field->setLightPos(handle, lighting::Vec2(x, y));
+		}
+		catch (...)
+		{
+			return RaiseCurrentException();
+		}
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Field_set_light_color(FieldObject* self, PyObject* args)
+	{
+		PyObject* light;
+		double r;
+		double g;
+		double b;
+		double intensity = 1.0;
+		lighting::LightHandle handle;
+		if (!PyArg_ParseTuple(args, "O(ddd)|d", &light, &r, &g, &b, &intensity) || !ParseLight(light, handle) || !CheckIdle(self) || !CheckAlive(self, handle))
+		{
+			return nullptr;
+		}
+
+		try
+		{
+			self->field->setLightColor(handle, lighting::ColorF(r, g, b));
+			self->field->setLightIntensity(handle, intensity);
+		}
+		catch (...)
+		{
+			return RaiseCurrentException();
+		}
+		Py_RETURN_NONE;
+	}
+
+	//cellsは1バイトの要素を持つ2次元のバッファ（numpyのuint8やboolの配列など）。0でない要素のセルが壁になる
+	//cells is a 2D buffer of 1-byte items (such as numpy uint8 or bool arrays). Cells of nonzero items become walls.
+	PyObject* Field_set_walls(FieldObject* self, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "cells", "x", "y", nullptr };
+		PyObject* cells;
+		int x = 0;
+		int y = 0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii", const_cast<char**>(keywords), &cells, &x, &y) || !CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		Py_buffer buffer;
+		if (PyObject_GetBuffer(cells, &buffer, PyBUF_RECORDS_RO) != 0)
+		{
+			return nullptr;
+		}
+
+		const lighting::Size size = self->field->gridSize();
+		if (buffer.ndim != 2 || buffer.itemsize != 1)
+		{
+			PyBuffer_Release(&buffer);
+			PyErr_SetString(PyExc_ValueError, "cells must be a 2D buffer of 1-byte items");
+			return nullptr;
+		}
+
+		const Py_ssize_t height = buffer.shape[0];
+		const Py_ssize_t width = buffer.shape[1];
+		if (x < 0 || y < 0 || size.x - x < width || size.y - y < height)
+		{
+			PyBuffer_Release(&buffer);
+			PyErr_SetString(PyExc_ValueError, "cells must lie inside the grid");
+			return nullptr;
+		}
+
+		try
+		{
+			auto edit = self->field->editWalls();
+			for (Py_ssize_t j = 0; j < height; ++j)
+			{
+				const char* row = static_cast<const char*>(buffer.buf) + j*buffer.strides[0];
+				for (Py_ssize_t i = 0; i < width; ++i)
+				{
+					const bool wall = row[i*buffer.strides[1]] != 0;
+					edit.set({ x + static_cast<int>(i), y + static_cast<int>(j) }, wall ? lighting::Field::FieldWall() : lighting::Field::FieldSpace());
+				}
+			}
+		}
+		catch (...)
+		{
+			PyBuffer_Release(&buffer);
+			return RaiseCurrentException();
+		}
+
+		PyBuffer_Release(&buffer);
+		Py_RETURN_NONE;
+	}
+
+	PyObject* NewGrid(FieldObject* self, GridKind kind)
+	{
+		if (!CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		GridObject* grid = PyObject_New(GridObject, &GridType);
+		if (!grid)
+		{
+			return nullptr;
+		}
+
+		Py_INCREF(self);
+		grid->owner = self;
+		grid->kind = kind;
+		return reinterpret_cast<PyObject*>(grid);
+	}
+
+	PyObject* Field_get_walls(FieldObject* self, void*)
+	{
+		return NewGrid(self, GridKind::Walls);
+	}
+
+	PyObject* Field_get_brightness(FieldObject* self, void*)
+	{
+		return NewGrid(self, GridKind::Brightness);
+	}
+
+	PyObject* Field_get_grid_size(FieldObject* self, void*)
+	{
+		if (!CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		const lighting::Size size = self->field->gridSize();
+		return Py_BuildValue("(ii)", size.x, size.y);
+	}
+
+	PyObject* Field_get_num_lights(FieldObject* self, void*)
+	{
+		if (!CheckIdle(self))
+		{
+			return nullptr;
+		}
+
+		return PyLong_FromSize_t(self->field->numLights());
+	}
+
+	PyMethodDef FieldMethods[] =
+	{
+		{ "step", reinterpret_cast<PyCFunction>(Field_step), METH_NOARGS, "Recompute light without moving lights. Releases the GIL." },
+		{ "add_light", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)()>(Field_add_light)), METH_VARARGS | METH_KEYWORDS, "add_light(x, y, color=(1, 1, 1), intensity=1.0, range=30.0) -> light. Position in pixels, range in cells." },
+		{ "remove_light", reinterpret_cast<PyCFunction>(Field_remove_light), METH_O, "remove_light(light) -> bool" },
+		{ "move_light", reinterpret_cast<PyCFunction>(Field_move_light), METH_VARARGS, "move_light(light, x, y)" },
+		{ "set_light_color", reinterpret_cast<PyCFunction>(Field_set_light_color), METH_VARARGS, "set_light_color(light, color, intensity=1.0)" },
+		{ "set_walls", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)()>(Field_set_walls)), METH_VARARGS | METH_KEYWORDS, "set_walls(cells, x=0, y=0). Nonzero items of the 2D buffer become walls." },
+		{ nullptr, nullptr, 0, nullptr }
+	};
+
+	PyGetSetDef FieldGetSet[] =
+	{
+		{ "walls", reinterpret_cast<getter>(Field_get_walls), nullptr, "Read-only uint8 view of walls, shape (height, width).", nullptr },
+		{ "brightness", reinterpret_cast<getter>(Field_get_brightness), nullptr, "Read-only float64 view of brightness, shape (height, width, 4) in RGBA.", nullptr },
+		{ "grid_size", reinterpret_cast<getter>(Field_get_grid_size), nullptr, "(width, height) in cells.", nullptr },
+		{ "num_lights", reinterpret_cast<getter>(Field_get_num_lights), nullptr, "Number of lights.", nullptr },
+		{ nullptr, nullptr, nullptr, nullptr, nullptr }
+	};
+
+	void Grid_dealloc(GridObject* self)
+	{
+		Py_DECREF(self->owner);
+		PyObject_Free(self);
+	}
+
+	//バッファはその時点でのフィールドのメモリを直接指す。書き込みは受け付けない
+	//The buffer points directly at the memory of the field at that time. Writing is not accepted.
+	int Grid_getbuffer(GridObject* self, Py_buffer* view, int flags)
+	{
+		FieldObject* owner = self->owner;
+		if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+		{
+			PyErr_SetString(PyExc_BufferError, "the grids of a field are read-only");
+			view->obj = nullptr;
+			return -1;
+		}
+
+		if (!CheckIdle(owner))
+		{
+			view->obj = nullptr;
+			return -1;
+		}
+
+		const lighting::Size size = owner->field->gridSize();
+		void* buf;
+		if (self->kind == GridKind::Walls)
+		{
+			buf = const_cast<char*>(owner->field->wallGrid().data());
+			view->itemsize = 1;
+			view->format = const_cast<char*>("B");
+			view->ndim = 2;
+			self->shape[0] = size.y;
+			self->shape[1] = size.x;
+			self->strides[0] = size.x;
+			self->strides[1] = 1;
+		}
+		else
+		{
+			buf = const_cast<lighting::ColorF*>(owner->field->brightnessGrid().data());
+			view->itemsize = sizeof(double);
+			view->format = const_cast<char*>("d");
+			view->ndim = 3;
+			self->shape[0] = size.y;
+			self->shape[1] = size.x;
+			self->shape[2] = 4;
+			self->strides[0] = size.x*sizeof(lighting::ColorF);
+			self->strides[1] = sizeof(lighting::ColorF);
+			self->strides[2] = sizeof(double);
+		}
+
+		view->buf = buf;
+		view->len = size.x*size.y*self->strides[1];
+		view->readonly = 1;
+		view->shape = self->shape;
+		view->strides = self->strides;
+		view->suboffsets = nullptr;
+		view->internal = nullptr;
+		if ((flags & PyBUF_FORMAT) != PyBUF_FORMAT)
+		{
+			view->format = nullptr;
+		}
+
+		view->obj = reinterpret_cast<PyObject*>(self);
+		Py_INCREF(self);
+		++owner->numExports;
+		return 0;
+	}
+
+	void Grid_releasebuffer(GridObject* self, Py_buffer*)
+	{
+		--self->owner->numExports;
+	}
+
+	PyBufferProcs GridBuffer =
+	{
+		reinterpret_cast<getbufferproc>(Grid_getbuffer),
+		reinterpret_cast<releasebufferproc>(Grid_releasebuffer)
+	};
+
+	PyModuleDef LightingModule =
+	{
+		PyModuleDef_HEAD_INIT,
+		"lighting",
+		"2D light propagation with a cellular automaton.",
+		-1,
+		nullptr
+	};
+}
+
+PyMODINIT_FUNC PyInit_lighting()
+{
+	FieldType.tp_name = "lighting.Field";
+	FieldType.tp_doc = "Field(width, height, grid_unit_pixel=8). Size in pixels. Starts with border walls and no lights.";
+	FieldType.tp_basicsize = sizeof(FieldObject);
+	FieldType.tp_flags = Py_TPFLAGS_DEFAULT;
+	FieldType.tp_new = PyType_GenericNew;
+	FieldType.tp_init = reinterpret_cast<initproc>(Field_init);
+	FieldType.tp_dealloc = reinterpret_cast<destructor>(Field_dealloc);
+	FieldType.tp_methods = FieldMethods;
+	FieldType.tp_getset = FieldGetSet;
+
+	GridType.tp_name = "lighting.Grid";
+	GridType.tp_doc = "Read-only view of a grid of a field. Use memoryview or numpy.asarray.";
+	GridType.tp_basicsize = sizeof(GridObject);
+	GridType.tp_flags = Py_TPFLAGS_DEFAULT;
+	GridType.tp_dealloc = reinterpret_cast<destructor>(Grid_dealloc);
+	GridType.tp_as_buffer = &GridBuffer;
+
+	if (PyType_Ready(&FieldType) < 0 || PyType_Ready(&GridType) < 0)
+	{
+		return nullptr;
+	}
+
+	PyObject* module = PyModule_Create(&LightingModule);
+	if (!module)
+	{
+		return nullptr;
+	}
+
+	Py_INCREF(&FieldType);
+	if (PyModule_AddObject(module, "Field", reinterpret_cast<PyObject*>(&FieldType)) < 0)
+	{
+		Py_DECREF(&FieldType);
+		Py_DECREF(module);
+		return nullptr;
+	}
+
+	return module;
+}